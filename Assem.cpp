@@ -5,9 +5,24 @@
 #include <stdio.h>
 
 #include "Assembler.h"
+#include "Benchmark.h"
 
 int main(int argc, char *argv[])
 {
+	// "Assem --bench [results.json]" times the emulator on its built-in kernels instead of
+	// assembling a file.
+	if (argc >= 2 && string(argv[1]) == "--bench")
+	{
+		Benchmark bench;
+		bench.RunSuite(cout);
+		if (argc >= 3 && !bench.WriteJson(argv[2]))
+		{
+			cerr << "Benchmark results could not be written to " << argv[2] << endl;
+			return 1;
+		}
+		return 0;
+	}
+
 	Assembler assem(argc, argv);
 
 	// Establish the location of the labels:
@@ -4,12 +4,266 @@
 #include "stdafx.h"
 #include "Assembler.h"
 #include "Errors.h"
+#include "CppTranslator.h"
+#include "SharedImage.h"
+#include "LaneEmulator.h"
+#include "SessionScheduler.h"
+#include "ResultCache.h"
+#include "Fuzzer.h"
+#include "Superoptimizer.h"
+#include "RecordPipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <thread>
+#include <atomic>
 
 // Constructor for the assembler.  Note: we are passing argc and argv to the file access constructor.
 Assembler::Assembler(int argc, char *argv[])
 	: m_facc(argc, argv)
 {
-	// Nothing else to do here.
+	ParseOptions(argc, argv);
+
+	// A pipe's standard output only carries results, so the listing goes to the error stream.
+	if (m_pipe)
+	{
+		m_stdoutBuffer = cout.rdbuf(cerr.rdbuf());
+	}
+}
+
+/*
+Assembler::ParseOptions()
+
+NAME
+
+Assembler::ParseOptions - applies the command line options given to the assembler
+
+SYNOPSIS
+
+void Assembler::ParseOptions(int argc, char *argv[]);
+	argc -> argument count from main
+	argv[] -> arguments from main
+
+DESCRIPTION
+
+This function goes through the arguments between the program name and the file name
+and applies each option. The options are:
+
+	--engine switch|threaded|jit|auto	selects the engine the emulator runs the program with
+	--verify			prints what the verifier found wrong with the program, if anything
+	--fuse				fuses common instruction sequences (threaded engine)
+	--fuse-profile <file>		fuses only the sequences that are hot in a saved profile
+	--fast-forward			skips ahead through the iterations of simple counting loops
+				(switch and threaded engines, when nothing is instrumented)
+	--profile			prints a profile of the run: op codes, hot instructions, branches,
+				memory use and hot loops, against the symbols and source lines
+	--profile-out <file>		saves how often each word was executed
+	--emit-cpp <file>		writes the program as C++ instead of running it
+	--input <file>			takes the values for READ from a file ("-" for standard input)
+				and holds back output until the program stops. Given more than
+				once, the program is run once for each file
+	--shared			runs each input file on its own instance of one shared copy of
+				the program, several at a time
+	--lanes				runs all of the input files at once, in lockstep lanes, and
+				reports the lane-instructions run per second
+	--cache <directory>		keeps what the program printed for each input file, in memory
+				and in files in the directory, and prints it again instead of
+				running the program when the same input comes back
+	--cache-entries <count>		the most results the cache keeps in memory (256 if not given)
+	--sessions			runs each input file as an interactive session, all on one thread,
+				with the values arriving one at a time
+	--fuel <count>			the most instructions a session runs before the next one gets a
+				turn, or a fuzzed run may take before it counts as a hang
+				(10000 if not given)
+	--session-fuel <count>		the most instructions a session may run without halting or
+				waiting for input before it is stopped with an error (10000000
+				if not given, 0 for no limit)
+	--fuzz <seconds>		searches for inputs that make the program stop with an error or
+				never halt, mutating the input files, and prints what it found
+	--pipe				runs the program once for every line of standard input, with the
+				values on the line for READ, and writes one line for each to
+				standard output: what the program wrote, then its error, if any.
+				The listing goes to the error stream and nothing waits for the user
+	--fuzz-threads <count>		the threads that fuzz the program (one for each processor if not
+				given)
+	--superopt <length>		after the run, searches the hottest straight-line code for shorter
+				sequences that do what sequences of up to 2 to 8 instructions do,
+				on one thread for each processor, and prints what it found
+	--map-in <address>:<file>	fills memory from the address with the words in a file
+	--map-out <address>:<count>:<file>	writes words of memory to a file when the program ends
+					(files ending in .bin hold raw words, others hold integers in text)
+	--trace				prints each instruction to the error stream as it runs
+	--check-bounds			stops the program if an operand is outside of memory
+	--step-limit <count>		stops the program after a number of instructions
+	--record <file>			records the values READ gets, with checkpoints of the state of
+				the run, into a compact binary log
+	--record-last <count>		also records the addresses of the last instructions run
+	--replay <file>			runs the program again with the values in a recorded log, without
+				reading any input, and reports where it differs from the recording
+
+An unknown option is reported and the assembler is terminated.
+*/
+void Assembler::ParseOptions(int argc, char *argv[])
+{
+	// The last argument is the file name, which FileAccess has already opened.
+	for (int i = 1; i < argc - 1; i++)
+	{
+		string option = argv[i];
+		string value = (i + 1 < argc - 1) ? argv[i + 1] : "";
+
+		if (option == "--engine" && value == "switch")
+		{
+			m_emul.SetEngine(Emulator::ENGINE_SWITCH);
+			i++;
+		}
+		else if (option == "--engine" && value == "threaded")
+		{
+			m_emul.SetEngine(Emulator::ENGINE_THREADED);
+			i++;
+		}
+		else if (option == "--engine" && value == "jit")
+		{
+			m_emul.SetEngine(Emulator::ENGINE_JIT);
+			i++;
+		}
+		else if (option == "--engine" && value == "auto")
+		{
+			m_emul.SetEngine(Emulator::ENGINE_AUTO);
+			i++;
+		}
+		else if (option == "--verify")
+		{
+			m_verify = true;
+		}
+		else if (option == "--fuse")
+		{
+			m_fuse = true;
+		}
+		else if (option == "--fast-forward")
+		{
+			m_emul.SetFastForward(true);
+		}
+		else if (option == "--fuse-profile" && !value.empty())
+		{
+			m_fuse = true;
+			m_fuseProfile = value;
+			i++;
+		}
+		else if (option == "--input" && !value.empty())
+		{
+			m_inputFiles.push_back(value);
+			i++;
+		}
+		else if (option == "--map-in" && value.find(':') != string::npos)
+		{
+			m_mapIn.push_back(value);
+			i++;
+		}
+		else if (option == "--map-out" && value.find(':') != value.rfind(':'))
+		{
+			m_mapOut.push_back(value);
+			i++;
+		}
+		else if (option == "--shared")
+		{
+			m_shared = true;
+		}
+		else if (option == "--lanes")
+		{
+			m_lanes = true;
+		}
+		else if (option == "--cache" && !value.empty())
+		{
+			m_cacheDirectory = value;
+			i++;
+		}
+		else if (option == "--cache-entries" && !value.empty())
+		{
+			m_cacheEntries = atoi(value.c_str());
+			i++;
+		}
+		else if (option == "--sessions")
+		{
+			m_sessions = true;
+		}
+		else if (option == "--fuel" && !value.empty())
+		{
+			m_fuel = atoll(value.c_str());
+			i++;
+		}
+		else if (option == "--session-fuel" && !value.empty())
+		{
+			m_sessionFuel = atoll(value.c_str());
+			i++;
+		}
+		else if (option == "--fuzz" && !value.empty())
+		{
+			m_fuzzSeconds = atof(value.c_str());
+			i++;
+		}
+		else if (option == "--pipe")
+		{
+			m_pipe = true;
+		}
+		else if (option == "--fuzz-threads" && !value.empty())
+		{
+			m_fuzzThreads = atoi(value.c_str());
+			i++;
+		}
+		else if (option == "--superopt" && !value.empty())
+		{
+			m_superoptLength = min(max(atoi(value.c_str()), 2), 8);
+			i++;
+		}
+		else if (option == "--trace")
+		{
+			m_trace = true;
+		}
+		else if (option == "--check-bounds")
+		{
+			m_checkBounds = true;
+		}
+		else if (option == "--step-limit" && !value.empty())
+		{
+			m_stepLimit = atoll(value.c_str());
+			i++;
+		}
+		else if (option == "--record" && !value.empty())
+		{
+			m_recordFile = value;
+			i++;
+		}
+		else if (option == "--record-last" && !value.empty())
+		{
+			m_recordLast = atoi(value.c_str());
+			i++;
+		}
+		else if (option == "--replay" && !value.empty())
+		{
+			m_replayFile = value;
+			i++;
+		}
+		else if (option == "--emit-cpp" && !value.empty())
+		{
+			m_emitCpp = value;
+			i++;
+		}
+		else if (option == "--profile")
+		{
+			m_profile = true;
+		}
+		else if (option == "--profile-out" && !value.empty())
+		{
+			m_profileOut = value;
+			i++;
+		}
+		else
+		{
+			cerr << "Unknown option: " << option << " " << value << endl;
+			cerr << "Usage: Assem [options] <FileName>" << endl;
+			exit(1);
+		}
+	}
 }
 
 /*
@@ -37,15 +291,15 @@ void Assembler::PassI()
 	for (; ; ) {
 
 		// Read the next line from the source file.
-		string buff;
-		if (!m_facc.GetNextLine(buff)) {
+		string_view line;
+		if (!m_facc.GetNextLine(line)) {
 
 			// If there are no more lines, we are missing an end statement.
 			// We will let this error be reported by Pass II.
 			return;
 		}
 		// Parse the line and get the instruction type.
-		Instruction::InstructionType st = m_inst.ParseInstruction(buff);
+		Instruction::InstructionType st = m_inst.ParseInstruction(line);
 
 		// If this is an end statement, there is nothing left to do in pass I.
 		// Pass II will determine if the end is the last statement.
@@ -88,6 +342,7 @@ void Assembler::PassII()
 {
 	m_facc.Rewind();	// Go back to the start of the file.
 	int currentLoc = 0;	// Keeps track of the current location in memory.
+	int lineNumber = 0;	// The line of the source file being translated.
 
 	cout << "Translation of Program:" << endl;
 	cout << "Location\tContents\tOriginal Statement" << endl;
@@ -96,8 +351,9 @@ void Assembler::PassII()
 	{
 		// Read the next line from the source file.
 		Errors::InitErrorReporting(); 
-		string buff;
-		if (!m_facc.GetNextLine(buff))	// We are missing an end statement, which is an error.
+		string_view line;
+		lineNumber++;
+		if (!m_facc.GetNextLine(line))	// We are missing an end statement, which is an error.
 		{
 			Errors::RecordError("ERROR: Missing an end statement!");
 			Errors::DisplayErrors();
@@ -105,11 +361,11 @@ void Assembler::PassII()
 		}
 
 		// Parse the line and get the instruction type.
-		Instruction::InstructionType st = m_inst.ParseInstruction(buff);
+		Instruction::InstructionType st = m_inst.ParseInstruction(line);
 
 		if (st == Instruction::ST_End)
 		{
-			if (!m_facc.GetNextLine(buff)) // This is actually the end statement.
+			if (!m_facc.GetNextLine(line)) // This is actually the end statement.
 			{
 				TranslateLine(st, currentLoc);
 				return;
@@ -128,6 +384,14 @@ void Assembler::PassII()
 		// Location does not get incremented if the line is a comment.
 		if (st != Instruction::ST_MachineLanguage && st != Instruction::ST_AssemblerInstr) continue;
 
+		// Remember where the word came from, so that a profile can point back to it.
+		if (m_profile && currentLoc < Emulator::MEMSZ && !Instruction::EqualsIgnoreCase(m_inst.GetOpCode(), "org"))
+		{
+			m_source.resize(Emulator::MEMSZ);
+			m_source[currentLoc].lineNumber = lineNumber;
+			m_source[currentLoc].statement = m_inst.GetOriginalStatement();
+		}
+
 		// Compute the location of the next instruction.
 		currentLoc = m_inst.LocationNextInstruction(currentLoc);
 	}
@@ -136,7 +400,7 @@ void Assembler::PassII()
 }
 
 // Runs the VC-3600 emulation (if possible), and displays errors if an error
-// occurred during run time.
+// occurred during run time. If a C++ translation was asked for, it is written instead.
 void Assembler::RunEmulator()
 {
 	if (m_hasErrors)
@@ -145,15 +409,579 @@ void Assembler::RunEmulator()
 		return;
 	}
 
-	Errors::InitErrorReporting();
-	cout << "Results from the emulating program:" << endl;
+	if (m_verify)
+	{
+		vector<string> problems;
+		if (m_emul.VerifyImage(problems))
+		{
+			cout << "The program passed verification and will run unchecked." << endl;
+		}
+		else
+		{
+			cout << "The program did not pass verification:" << endl;
+			for (size_t i = 0; i < problems.size(); i++)
+			{
+				cout << "\t" << problems[i] << endl;
+			}
+		}
+		cout << endl;
+	}
+
+	if (!m_emitCpp.empty())
+	{
+		CppTranslator translator(m_emul);
+		if (translator.Translate(m_emitCpp))
+		{
+			cout << "C++ translation written to " << m_emitCpp << endl;
+		}
+		else
+		{
+			cout << "C++ translation could not be written to " << m_emitCpp << endl;
+		}
+		return;
+	}
+
+	if (!m_fuseProfile.empty() && !m_emul.LoadProfile(m_fuseProfile))
+	{
+		cout << "Profile " << m_fuseProfile << " could not be read, fusing every sequence." << endl;
+	}
+	if (m_fuse)
+	{
+		m_emul.FuseInstructions();
+	}
+	if (!MapMemory())
+	{
+		return;
+	}
+	m_emul.SetProfiling(m_profile || !m_profileOut.empty() || m_superoptLength > 0);
+	m_emul.SetTracing(m_trace);
+	m_emul.SetBoundsChecking(m_checkBounds);
+	m_emul.SetStepLimit(m_stepLimit);
+
+	if (m_pipe)
+	{
+		RunPipe();
+		return;
+	}
+	if (m_fuzzSeconds > 0)
+	{
+		RunFuzzer();
+		return;
+	}
+	if (m_lanes && !m_inputFiles.empty())
+	{
+		RunLanes();
+		return;
+	}
+	if (m_sessions && !m_inputFiles.empty())
+	{
+		RunSessions();
+		return;
+	}
+	if (m_shared && !m_inputFiles.empty())
+	{
+		RunSharedInstances();
+		return;
+	}
+
+	// With several input files, the program is run once for each, going back to the loaded
+	// program between runs.
+	int runs = m_inputFiles.empty() ? 1 : (int)m_inputFiles.size();
+	if (runs > 1)
+	{
+		m_emul.TakeSnapshot();
+	}
+	if (!StartExecutionLog(runs))
+	{
+		return;
+	}
+	bool caching = StartResultCache();
+	for (int run = 0; run < runs; run++)
+	{
+		if (caching)
+		{
+			if (!RunThroughCache(m_inputFiles[run], runs > 1))
+			{
+				return;
+			}
+			continue;
+		}
+		if (!m_inputFiles.empty())
+		{
+			if (!m_batch.LoadInput(m_inputFiles[run]))
+			{
+				cout << "Input file " << m_inputFiles[run] << " could not be read." << endl;
+				return;
+			}
+			m_emul.SetIODevice(&m_batch);
+		}
+		if (run > 0)
+		{
+			m_emul.ResetToSnapshot();
+		}
+
+		Errors::InitErrorReporting();
+		cout << "Results from the emulating program";
+		if (runs > 1)
+		{
+			cout << " with input " << m_inputFiles[run];
+		}
+		cout << ":" << endl;
+		cout << endl;
+		if (!m_emul.RunProgram())
+		{
+			Errors::DisplayErrors();
+		}
+		cout << endl;
+		cout << "End of emulation." << endl;
+	}
+
+	if (!m_replayFile.empty())
+	{
+		ReportReplay();
+	}
+	if (caching)
+	{
+		long long lookups = m_cache.GetHits() + m_cache.GetMisses();
+		cout << endl;
+		cout << "Result cache: " << m_cache.GetHits() << " of " << lookups << " runs were hits ("
+			<< fixed << setprecision(1) << 100.0 * m_cache.GetHits() / lookups << "%), "
+			<< m_cache.GetDiskHits() << " of them from disk." << endl;
+		cout.unsetf(ios::floatfield);
+	}
+	if (!m_profileOut.empty() && !m_emul.SaveProfile(m_profileOut))
+	{
+		cout << "Profile could not be written to " << m_profileOut << endl;
+	}
+	if (m_profile)
+	{
+		cout << endl;
+		if (m_emul.GetProfiler().IsEmpty())
+		{
+			cout << "Profiling is not compiled into this build." << endl;
+		}
+		else
+		{
+			m_emul.GetProfiler().Report(cout, m_source, m_symtab.GetSymbols());
+		}
+	}
+	if (m_superoptLength > 0)
+	{
+		RunSuperoptimizer();
+	}
+}
+
+// Starts recording the run into a log, or replaying it from one, if either was asked for.
+// Only a single run can be logged. Returns false if the log cannot be used.
+bool Assembler::StartExecutionLog(int a_runs)
+{
+	if (m_recordFile.empty() && m_replayFile.empty())
+	{
+		return true;
+	}
+	if (a_runs > 1 || (!m_recordFile.empty() && !m_replayFile.empty()))
+	{
+		cout << "Only a single run can be recorded or replayed." << endl;
+		return false;
+	}
+	if (!m_recordFile.empty() && !m_log.StartRecording(m_recordFile, m_recordLast))
+	{
+		cout << "The run could not be recorded in " << m_recordFile << endl;
+		return false;
+	}
+	if (!m_replayFile.empty() && !m_log.StartReplay(m_replayFile))
+	{
+		cout << "The recorded run could not be read from " << m_replayFile << endl;
+		return false;
+	}
+	m_emul.SetExecutionLog(&m_log);
+	return true;
+}
+
+// Sets up the result cache, if it was asked for and can be used. A cached result stands in for
+// the whole run, so the cache is not used for runs that are observed in any other way, or that
+// write files. Returns true if the runs are to go through the cache.
+bool Assembler::StartResultCache()
+{
+	if (m_cacheDirectory.empty())
+	{
+		return false;
+	}
+	if (m_inputFiles.empty() || !m_mapOut.empty() || m_trace || m_profile || !m_profileOut.empty() ||
+		m_checkBounds || m_stepLimit != 0 || !m_recordFile.empty() || !m_replayFile.empty())
+	{
+		cout << "The result cache needs --input, and is not used with --map-out, instrumentation, --record or --replay." << endl;
+		return false;
+	}
+	m_cache.Configure(m_cacheEntries, m_cacheDirectory);
+	m_imageHash = ResultCache::HashImage(m_emul);
+	return true;
+}
+
+/*
+Assembler::RunThroughCache()
+
+NAME
+
+Assembler::RunThroughCache - runs the program on an input file, unless its result is cached
+
+SYNOPSIS
+
+bool Assembler::RunThroughCache(const string &a_inputFile, bool a_reset);
+	a_inputFile -> the file holding the values for READ
+	a_reset -> true if memory must be put back to the snapshot before the program runs
+
+DESCRIPTION
+
+This function looks up the program and the values in the input file in the result cache. On a
+hit, the output and errors that were kept are printed and the program is not run at all. On a
+miss, the program is run with its output collected, and the output, whether it succeeded, and
+the errors it recorded are kept in the cache. Either way, what is printed is exactly what a run
+without the cache would print.
+
+RETURNS
+
+Returns true if the program was run or its result was found. Returns false if the input file
+could not be read.
+*/
+bool Assembler::RunThroughCache(const string &a_inputFile, bool a_reset)
+{
+	ostringstream output;
+	BatchDevice device(output);
+	if (!device.LoadInput(a_inputFile))
+	{
+		cout << "Input file " << a_inputFile << " could not be read." << endl;
+		return false;
+	}
+
+	string key = ResultCache::MakeKey(m_imageHash, device.GetInput());
+	ResultCache::Result result;
+	if (!m_cache.Find(key, result))
+	{
+		if (a_reset)
+		{
+			m_emul.ResetToSnapshot();
+		}
+		m_emul.SetIODevice(&device);
+		Errors::InitErrorReporting();
+		result.succeeded = m_emul.RunProgram();
+		m_emul.SetIODevice(NULL);
+		result.output = output.str();
+		if (!result.succeeded)
+		{
+			result.errors = Errors::GetErrors();
+		}
+		m_cache.Store(key, result);
+	}
+
+	cout << "Results from the emulating program";
+	if (m_inputFiles.size() > 1)
+	{
+		cout << " with input " << a_inputFile;
+	}
+	cout << ":" << endl;
 	cout << endl;
-	if (!m_emul.RunProgram())
+	cout << result.output;
+	for (size_t i = 0; i < result.errors.size(); i++)
 	{
-		Errors::DisplayErrors();
+		cout << result.errors[i] << endl;
 	}
 	cout << endl;
 	cout << "End of emulation." << endl;
+	return true;
+}
+
+// Reports whether the replayed run matched the recording, and where the recorded run last was.
+void Assembler::ReportReplay()
+{
+	cout << endl;
+	if (m_log.GetDivergence().empty())
+	{
+		cout << "The replayed run matched the recorded run." << endl;
+	}
+	else
+	{
+		cout << m_log.GetDivergence() << endl;
+	}
+
+	const vector<int> &addresses = m_log.GetLastAddresses();
+	if (!addresses.empty())
+	{
+		cout << "The last " << addresses.size() << " instructions of the recorded run were at:" << endl;
+		for (size_t i = 0; i < addresses.size(); i++)
+		{
+			cout << addresses[i] << ((i % 10 == 9 || i + 1 == addresses.size()) ? "\n" : " ");
+		}
+	}
+}
+
+/*
+Assembler::RunSharedInstances()
+
+NAME
+
+Assembler::RunSharedInstances - runs the program once for each input file, several at a time
+
+SYNOPSIS
+
+void Assembler::RunSharedInstances();
+
+DESCRIPTION
+
+This function copies the loaded program into one SharedImage and runs it on an ImageInstance
+for each input file, with one thread for each processor. Each instance only holds the words
+the program writes, so many runs cost little more memory than one. Each run's output is
+collected and printed in the order the input files were given, in the same form as the runs
+RunEmulator makes one after the other. Instrumentation and --map-out do not apply.
+*/
+void Assembler::RunSharedInstances()
+{
+	shared_ptr<const SharedImage> image = make_shared<SharedImage>(m_emul);
+	vector<string> outputs(m_inputFiles.size());
+	atomic<size_t> nextRun(0);
+
+	auto worker = [&]()
+	{
+		ImageInstance instance(image);
+		for (size_t run = nextRun++; run < m_inputFiles.size(); run = nextRun++)
+		{
+			ostringstream out;
+			BatchDevice device(out);
+			if (!device.LoadInput(m_inputFiles[run]))
+			{
+				outputs[run] = "Input file " + m_inputFiles[run] + " could not be read.\n";
+				continue;
+			}
+			instance.Reset();
+			if (!instance.Run(device))
+			{
+				out << instance.GetError() << endl;
+			}
+			outputs[run] = out.str();
+		}
+	};
+
+	size_t threadCount = max(1u, thread::hardware_concurrency());
+	threadCount = min(threadCount, m_inputFiles.size());
+	vector<thread> threads;
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		threads.push_back(thread(worker));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	for (size_t run = 0; run < outputs.size(); run++)
+	{
+		cout << "Results from the emulating program";
+		if (outputs.size() > 1)
+		{
+			cout << " with input " << m_inputFiles[run];
+		}
+		cout << ":" << endl;
+		cout << endl;
+		cout << outputs[run];
+		cout << endl;
+		cout << "End of emulation." << endl;
+	}
+}
+
+/*
+Assembler::RunSessions()
+
+NAME
+
+Assembler::RunSessions - runs the program for every input file as sessions that take turns
+
+SYNOPSIS
+
+void Assembler::RunSessions();
+
+DESCRIPTION
+
+This function starts a session of one SessionScheduler for each input file, and plays the part
+of the users: in each round, every session that is waiting for input is given the next value
+from its file, or told that there are no more, and then every session that is ready has one
+turn. Sessions that are waiting for input cost nothing until their value arrives, and none can
+run for more than --fuel instructions while others are ready. A session that runs --session-fuel
+instructions without halting or waiting for input is stopped with an error. The output of each
+session is printed in the order the input files were given, in the same form as RunEmulator
+prints separate runs, followed by how the turns went. Instrumentation and --map-out do not apply.
+*/
+void Assembler::RunSessions()
+{
+	shared_ptr<const SharedImage> image = make_shared<SharedImage>(m_emul);
+	SessionScheduler scheduler(image, m_fuel, m_sessionFuel);
+	vector<vector<long long>> inputs(m_inputFiles.size());
+	vector<size_t> nextInput(m_inputFiles.size(), 0);
+	vector<string> outputs(m_inputFiles.size());
+	for (size_t run = 0; run < m_inputFiles.size(); run++)
+	{
+		string text;
+		if (!ReadWholeFile(m_inputFiles[run], text))
+		{
+			cout << "Input file " << m_inputFiles[run] << " could not be read." << endl;
+			return;
+		}
+		ParseIntegers(text.data(), text.size(), inputs[run]);
+		scheduler.AddSession();
+	}
+
+	auto start = chrono::steady_clock::now();
+	int rounds = 0;
+	for (size_t finished = 0; finished < inputs.size(); rounds++)
+	{
+		for (size_t run = 0; run < inputs.size(); run++)
+		{
+			if (!scheduler.IsWaiting((int)run))
+			{
+				continue;
+			}
+			if (nextInput[run] < inputs[run].size())
+			{
+				scheduler.Push((int)run, inputs[run][nextInput[run]++]);
+			}
+			else
+			{
+				scheduler.CloseInput((int)run);
+			}
+		}
+		scheduler.RunRound();
+
+		finished = 0;
+		for (size_t run = 0; run < inputs.size(); run++)
+		{
+			outputs[run] += scheduler.TakeOutput((int)run);
+			finished += scheduler.IsFinished((int)run) ? 1 : 0;
+		}
+	}
+	chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+
+	for (size_t run = 0; run < outputs.size(); run++)
+	{
+		cout << "Results from the emulating program";
+		if (outputs.size() > 1)
+		{
+			cout << " with input " << m_inputFiles[run];
+		}
+		cout << ":" << endl;
+		cout << endl;
+		cout << outputs[run];
+		if (!scheduler.GetError((int)run).empty())
+		{
+			cout << scheduler.GetError((int)run) << endl;
+		}
+		cout << endl;
+		cout << "End of emulation." << endl;
+	}
+	cout << endl;
+	cout << outputs.size() << " sessions took " << scheduler.GetTurns() << " turns over " << rounds << " rounds in "
+		<< seconds.count() << " seconds: " << scheduler.GetWaits() << " waited for input and "
+		<< scheduler.GetPreemptions() << " used up their fuel." << endl;
+}
+
+/*
+Assembler::RunLanes()
+
+NAME
+
+Assembler::RunLanes - runs the program over every input file at once, in lockstep lanes
+
+SYNOPSIS
+
+void Assembler::RunLanes();
+
+DESCRIPTION
+
+This function gives each input file a lane of a LaneEmulator and runs them all together. Each
+lane's output is collected and printed in the order the input files were given, in the same form
+as RunEmulator prints separate runs, followed by the number of lane-instructions run per second.
+Instrumentation and --map-out do not apply.
+*/
+void Assembler::RunLanes()
+{
+	shared_ptr<const SharedImage> image = make_shared<SharedImage>(m_emul);
+	int laneCount = (int)m_inputFiles.size();
+	LaneEmulator lanes(image, laneCount);
+
+	vector<ostringstream> outputs(laneCount);
+	vector<unique_ptr<BatchDevice>> devices;
+	for (int lane = 0; lane < laneCount; lane++)
+	{
+		devices.push_back(unique_ptr<BatchDevice>(new BatchDevice(outputs[lane])));
+		if (!devices[lane]->LoadInput(m_inputFiles[lane]))
+		{
+			cout << "Input file " << m_inputFiles[lane] << " could not be read." << endl;
+			return;
+		}
+		lanes.SetLaneDevice(lane, devices[lane].get());
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	lanes.Run();
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	for (int lane = 0; lane < laneCount; lane++)
+	{
+		cout << "Results from the emulating program";
+		if (laneCount > 1)
+		{
+			cout << " with input " << m_inputFiles[lane];
+		}
+		cout << ":" << endl;
+		cout << endl;
+		cout << outputs[lane].str();
+		if (!lanes.GetError(lane).empty())
+		{
+			cout << lanes.GetError(lane) << endl;
+		}
+		cout << endl;
+		cout << "End of emulation." << endl;
+	}
+
+	cout << endl;
+	if (lanes.IsLockstep())
+	{
+		cout << laneCount << " lanes ran " << lanes.GetLaneInstructions() << " lane-instructions in "
+			<< seconds << " seconds (" << (seconds > 0 ? lanes.GetLaneInstructions() / seconds : 0)
+			<< " per second)." << endl;
+	}
+	else
+	{
+		cout << "The program changes its own code, so its " << laneCount << " lanes ran one at a time in "
+			<< seconds << " seconds." << endl;
+	}
+}
+
+// Sets up the memory windows given with --map-in and --map-out. "address:file" loads a file
+// into memory from the address, and "address:count:file" saves that many words when the program
+// ends. The file name is everything after the colons it needs, so it may hold colons itself.
+bool Assembler::MapMemory()
+{
+	for (size_t i = 0; i < m_mapIn.size(); i++)
+	{
+		size_t colon = m_mapIn[i].find(':');
+		if (!m_emul.MapIn(atoi(m_mapIn[i].substr(0, colon).c_str()), m_mapIn[i].substr(colon + 1)))
+		{
+			cout << "Memory could not be loaded from " << m_mapIn[i] << endl;
+			return false;
+		}
+	}
+	for (size_t i = 0; i < m_mapOut.size(); i++)
+	{
+		size_t first = m_mapOut[i].find(':');
+		size_t second = m_mapOut[i].find(':', first + 1);
+		int location = atoi(m_mapOut[i].substr(0, first).c_str());
+		int count = atoi(m_mapOut[i].substr(first + 1, second - first - 1).c_str());
+		if (!m_emul.MapOut(location, count, m_mapOut[i].substr(second + 1)))
+		{
+			cout << "Memory window " << m_mapOut[i] << " is outside of memory." << endl;
+			return false;
+		}
+	}
+	return true;
 }
 
 /*
@@ -180,7 +1008,7 @@ encountered.
 */
 void Assembler::TranslateLine(Instruction::InstructionType a_statement, int a_location)
 {
-	int contents = 0;  // This is the contents in memory that will be stored at a given address.
+	Emulator::Word contents = 0;  // This is the contents in memory that will be stored at a given address.
 	string printContents = ""; // The same contents as above, but stored as a string.
 
 	// End statements and comments have no location or contents.
@@ -216,7 +1044,7 @@ void Assembler::TranslateLine(Instruction::InstructionType a_statement, int a_lo
 		}
 		else
 		{
-			contents = stoi(printContents);
+			contents = (Emulator::Word)stoll(printContents);
 			if (!m_emul.InsertMemory(a_location, contents))
 			{
 				Errors::RecordError("ERROR: Error inserting into memory!");
@@ -240,15 +1068,15 @@ void Assembler::TranslateLine(Instruction::InstructionType a_statement, int a_lo
 		}
 		else
 		{	
-			if (m_inst.GetOpCode() == "ds" ||
-				m_inst.GetOpCode() == "org")
+			if (Instruction::EqualsIgnoreCase(m_inst.GetOpCode(), "ds") ||
+				Instruction::EqualsIgnoreCase(m_inst.GetOpCode(), "org"))
 			{
 				// Do not insert into memory.
 				return;
 			}
 			else
 			{
-				contents = stoi(printContents);
+				contents = (Emulator::Word)stoll(printContents);
 				if (!m_emul.InsertMemory(a_location, contents))
 				{
 					Errors::RecordError("ERROR: Error inserting into memory!");
@@ -298,10 +1126,12 @@ void Assembler::TranslateMachineLanguage(string & a_stringContents)
 	}
 
 
-	// Is this a halt or something with an operand?
+	// Is this a halt or something with an operand? Addresses take up as many digits
+	// as the largest address in memory.
+	int addressDigits = FindDigits(Emulator::ADDRESS_RADIX - 1);
 	if (m_inst.GetNumOpCode() == 13)
 	{
-		a_stringContents += "0000";
+		a_stringContents += string(addressDigits, '0');
 	}
 	// If not, we find the operand's location.
 	else
@@ -329,12 +1159,12 @@ void Assembler::TranslateMachineLanguage(string & a_stringContents)
 					Errors::RecordError("ERROR: Label is multiply defined!");
 					m_hasErrors = true;
 				}
-				if (symbolLoc >= 10000) // Address is too large to store in the computer.
+				if (symbolLoc >= Emulator::MEMSZ) // Address is too large to store in the computer.
 				{
 					Errors::RecordError("ERROR: Address is too large to store in memory!");
 					m_hasErrors = true;
 				}
-				if (symbolLoc < 1000)
+				for (int i = FindDigits(symbolLoc); i < addressDigits; i++)
 				{
 					a_stringContents += "0";
 				}
@@ -376,14 +1206,10 @@ void Assembler::TranslateAssemblerLanguage(string & a_stringContents, int a_loca
 {
 	// Determine if this is a legal assembly instruction.
 
-	string origOpCode = m_inst.GetOpCode();
-	for (int i = 0; i < origOpCode.length(); i++)
-	{
-		origOpCode[i] = tolower(origOpCode[i]);
-	}
+	string_view origOpCode = m_inst.GetOpCode();
 
-	if (origOpCode == "ds" ||
-		origOpCode == "org") // Defining storage and setting the origin does not have contents in memory.
+	if (Instruction::EqualsIgnoreCase(origOpCode, "ds") ||
+		Instruction::EqualsIgnoreCase(origOpCode, "org")) // Defining storage and setting the origin does not have contents in memory.
 	{
 		bool isANumerical = m_inst.IsNumOperand();
 		if (!isANumerical)	// The ds and org instructions can only have numerical operands.
@@ -392,7 +1218,7 @@ void Assembler::TranslateAssemblerLanguage(string & a_stringContents, int a_loca
 			m_hasErrors = true;
 		}
 
-		if (m_inst.GetNumOperand() > 9999) // Cannot store in memory addresses above 9999.
+		if (m_inst.GetNumOperand() >= Emulator::MEMSZ) // Cannot store in memory addresses past the end.
 		{
 			Errors::RecordError("ERROR: Operand address value is too large!");
 			m_hasErrors = true;
@@ -400,7 +1226,7 @@ void Assembler::TranslateAssemblerLanguage(string & a_stringContents, int a_loca
 
 		int newLoc = a_location + m_inst.GetNumOperand();
 
-		if (newLoc > 9999) // Cannot store in memory addresses above 9999.
+		if (newLoc >= Emulator::MEMSZ) // Cannot store in memory addresses past the end.
 		{
 			Errors::RecordError("ERROR: Operand address value is too large!");
 			m_hasErrors = true;
@@ -408,7 +1234,7 @@ void Assembler::TranslateAssemblerLanguage(string & a_stringContents, int a_loca
 	}
 	else
 	{
-		if (origOpCode != "dc")
+		if (!Instruction::EqualsIgnoreCase(origOpCode, "dc"))
 		{
 			Errors::RecordError("ERROR: Illegal op code!");
 			m_hasErrors = true;
@@ -419,7 +1245,7 @@ void Assembler::TranslateAssemblerLanguage(string & a_stringContents, int a_loca
 
 		int value = m_inst.GetNumOperand();
 
-		if (value > 999999) // Value is too big to store in memory.
+		if (value > Emulator::MAX_WORD) // Value is too big to store in memory.
 		{
 			Errors::RecordError("ERROR: Value too big to store in memory!");
 			a_stringContents += to_string(value);
@@ -431,7 +1257,7 @@ void Assembler::TranslateAssemblerLanguage(string & a_stringContents, int a_loca
 
 			int digitNum = FindDigits(value);
 
-			for (int i = digitNum; i < 6; i++)
+			for (int i = digitNum; i < FindDigits(Emulator::MAX_WORD); i++)
 			{
 				a_stringContents += "0";
 			}
@@ -445,3 +1271,175 @@ void Assembler::TranslateAssemblerLanguage(string & a_stringContents, int a_loca
 		}
 	}
 }
+
+/*
+Assembler::RunFuzzer()
+
+NAME
+
+Assembler::RunFuzzer - searches for inputs that make the program fail or never halt
+
+SYNOPSIS
+
+void Assembler::RunFuzzer();
+
+DESCRIPTION
+
+This function copies the loaded program into one SharedImage and has a Fuzzer search it for
+--fuzz seconds, on --fuzz-threads threads. The values in the input files are the inputs it
+starts from; with none, it starts from no input at all. A run that takes more than --fuel
+instructions counts as a hang. It prints how many runs were made and how fast, how much of the
+program's branching was covered, and each finding, with the location it was found at and the
+values for READ that lead to it. Instrumentation and --map-out do not apply.
+*/
+void Assembler::RunFuzzer()
+{
+	shared_ptr<const SharedImage> image = make_shared<SharedImage>(m_emul);
+	Fuzzer fuzzer(image, m_fuel > 0 ? m_fuel : 10000);
+	for (size_t run = 0; run < m_inputFiles.size(); run++)
+	{
+		string text;
+		if (!ReadWholeFile(m_inputFiles[run], text))
+		{
+			cout << "Input file " << m_inputFiles[run] << " could not be read." << endl;
+			return;
+		}
+		vector<long long> values;
+		ParseIntegers(text.data(), text.size(), values);
+		fuzzer.AddSeed(values);
+	}
+
+	int threads = (m_fuzzThreads > 0) ? m_fuzzThreads : (int)max(1u, thread::hardware_concurrency());
+	cout << "Fuzzing for " << m_fuzzSeconds << " seconds on " << threads << " threads..." << endl;
+	auto start = chrono::steady_clock::now();
+	fuzzer.Run(threads, m_fuzzSeconds);
+	chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+
+	cout << fuzzer.GetExecutions() << " runs (" << fixed << setprecision(0) << fuzzer.GetExecutions() / seconds.count()
+		<< " a second), " << fuzzer.GetCorpusSize() << " inputs kept, " << fuzzer.GetEdgesCovered()
+		<< " branch ways covered." << endl;
+
+	vector<Fuzzer::Finding> findings = fuzzer.GetFindings();
+	cout << endl;
+	cout << findings.size() << (findings.size() == 1 ? " finding" : " findings") << (findings.empty() ? "." : ":") << endl;
+	for (size_t i = 0; i < findings.size(); i++)
+	{
+		const Fuzzer::Finding &finding = findings[i];
+		cout << "\t" << (finding.kind == Fuzzer::FIND_ERROR ? "Error" : "Hang") << " at location "
+			<< finding.address << ": " << finding.message << endl;
+		cout << "\t\tinput:";
+		for (size_t value = 0; value < finding.input.size(); value++)
+		{
+			cout << " " << finding.input[value];
+		}
+		cout << (finding.input.empty() ? " (none)" : "") << endl;
+	}
+}
+
+/*
+Assembler::RunPipe()
+
+NAME
+
+Assembler::RunPipe - runs the program once for every record on standard input
+
+SYNOPSIS
+
+void Assembler::RunPipe();
+
+DESCRIPTION
+
+This function hands the loaded program to a RecordPipeline, which runs it on each line of
+standard input and writes the results to standard output, one line for each (see
+RecordPipeline::Run). Standard output gets its buffer back first, having been sent to the error
+stream while the program was assembled. How many records were run, and how fast, goes to the
+error stream, so that standard output only carries results.
+*/
+void Assembler::RunPipe()
+{
+	cout.rdbuf(m_stdoutBuffer);
+
+	RecordPipeline pipeline(m_emul);
+	auto start = chrono::steady_clock::now();
+	pipeline.Run(cin, cout);
+	chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+
+	cerr << pipeline.GetRecordCount() << " records in " << seconds.count() << " seconds ("
+		<< fixed << setprecision(0) << pipeline.GetRecordCount() / max(seconds.count(), 1e-9) << " a second), "
+		<< pipeline.GetFailureCount() << " stopped with an error." << endl;
+}
+
+/*
+Assembler::RunSuperoptimizer()
+
+NAME
+
+Assembler::RunSuperoptimizer - searches the hot code of the run for shorter sequences
+
+SYNOPSIS
+
+void Assembler::RunSuperoptimizer();
+
+DESCRIPTION
+
+This function has a Superoptimizer search the blocks of straight-line code that the run spent
+the most time in, going by its profile, for sequences of up to --superopt instructions that a
+shorter sequence does the same as. It prints how many sequences and candidates were tried and
+how fast, then each shorter sequence found, with its operands named by their symbols.
+*/
+void Assembler::RunSuperoptimizer()
+{
+	const int SUPEROPT_BLOCKS = 5;
+	static const char *const mnemonics[] = {
+		"", "ADD", "SUB", "MULT", "DIV", "LOAD", "STORE", "READ", "WRITE", "B", "BM", "BZ", "BP", "HALT"
+	};
+
+	map<int, string> names;
+	const map<string, int, less<>> &symbols = m_symtab.GetSymbols();
+	for (map<string, int, less<>>::const_iterator symbol = symbols.begin(); symbol != symbols.end(); ++symbol)
+	{
+		names.insert(make_pair(symbol->second, symbol->first));
+	}
+	auto printSequence = [&](const vector<Superoptimizer::Step> &a_steps)
+	{
+		for (size_t i = 0; i < a_steps.size(); i++)
+		{
+			map<int, string>::const_iterator name = names.find(a_steps[i].address);
+			cout << (i == 0 ? "" : " / ") << mnemonics[a_steps[i].opCode] << " "
+				<< (name != names.end() ? name->second : to_string(a_steps[i].address));
+		}
+		cout << (a_steps.empty() ? "(nothing)" : "") << endl;
+	};
+
+	int threads = (int)max(1u, thread::hardware_concurrency());
+	cout << endl;
+	cout << "Superoptimizing the " << SUPEROPT_BLOCKS << " hottest blocks, for sequences of up to "
+		<< m_superoptLength << " instructions, on " << threads << (threads == 1 ? " thread..." : " threads...") << endl;
+	Superoptimizer superoptimizer(m_emul, m_superoptLength, threads);
+	auto start = chrono::steady_clock::now();
+	if (!superoptimizer.Run(m_emul.GetProfiler(), SUPEROPT_BLOCKS))
+	{
+		cout << "The program writes to its own code, so none of it can be replaced." << endl;
+		return;
+	}
+	chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+	cout << superoptimizer.GetTargetCount() << " sequences searched, " << superoptimizer.GetCandidateCount()
+		<< " candidates tried (" << fixed << setprecision(0)
+		<< superoptimizer.GetCandidateCount() / max(seconds.count(), 1e-9) << " a second)." << endl;
+	cout.unsetf(ios::floatfield);
+
+	const vector<Superoptimizer::Finding> &findings = superoptimizer.GetFindings();
+	cout << endl;
+	cout << findings.size() << (findings.size() == 1 ? " shorter sequence" : " shorter sequences")
+		<< (findings.empty() ? "." : ":") << endl;
+	for (size_t i = 0; i < findings.size(); i++)
+	{
+		const Superoptimizer::Finding &finding = findings[i];
+		cout << "\tAt location " << finding.location << ", run " << finding.executions << " times:" << endl;
+		cout << "\t\t";
+		printSequence(finding.target);
+		cout << "\t\tcan be ";
+		printSequence(finding.replacement);
+		cout << "\t\t(the same on " << finding.vectorsChecked << " inputs)" << endl;
+	}
+}
@@ -8,6 +8,8 @@
 #include "Instruction.h"
 #include "FileAccess.h"
 #include "Emulator.h"
+#include "ExecutionLog.h"
+#include "ResultCache.h"
 
 
 class Assembler {
@@ -21,14 +23,50 @@ public:
 	// Pass II - generate a translation
 	void PassII();
 
-	// Displays the symbols in the symbol table.
-	void DisplaySymbolTable() { m_symtab.DisplaySymbolTable(); }
+	// Displays the symbols in the symbol table. A pipe does not stop to wait for the user.
+	void DisplaySymbolTable() { m_symtab.DisplaySymbolTable(!m_pipe); }
 
 	// Run emulator on the translation.
 	void RunEmulator();
 
 private:
 
+	// Applies the command line options that come before the file name.
+	void ParseOptions(int argc, char *argv[]);
+
+	// Starts recording or replaying the run, if asked to.
+	bool StartExecutionLog(int a_runs);
+
+	// Reports how the replayed run compared with the recording.
+	void ReportReplay();
+
+	// Sets up the result cache, if asked to. Returns true if the runs go through it.
+	bool StartResultCache();
+
+	// Prints the result of running the program on an input file, from the cache if it is there.
+	bool RunThroughCache(const string &a_inputFile, bool a_reset);
+
+	// Runs the program for each input file on instances that share one copy of it.
+	void RunSharedInstances();
+
+	// Runs the program for each input file as interactive sessions that take turns on one thread.
+	void RunSessions();
+
+	// Runs the program for all of the input files at once, in lockstep lanes.
+	void RunLanes();
+
+	// Searches for inputs that make the program fail or never halt, starting from the input files.
+	void RunFuzzer();
+
+	// Runs the program once for every line of standard input, writing only the results.
+	void RunPipe();
+
+	// Searches the hottest straight-line code of the run for shorter equivalent sequences.
+	void RunSuperoptimizer();
+
+	// Loads and registers the memory windows given on the command line.
+	bool MapMemory();
+
 	// Prints the machine language translation and inserts into memory, if possible.
 	void TranslateLine(Instruction::InstructionType a_statement, int a_location);
 
@@ -39,7 +77,7 @@ private:
 	void TranslateAssemblerLanguage(string & a_stringContents, int a_location);
 
 	// Determines the amount of digits in a number.
-	int FindDigits(int a_value)
+	int FindDigits(long long a_value)
 	{
 		int count = 0;
 		while (a_value != 0)
@@ -55,4 +93,36 @@ private:
 	Instruction m_inst;	    // Instruction object
 	Emulator m_emul;        // Emulator for VC3600
 	bool m_hasErrors = false; // Determines if there are errors in Pass II.
+	bool m_verify = false;	// == true if the verifier's findings are printed.
+	bool m_fuse = false;	// == true if instruction sequences are to be fused.
+	string m_fuseProfile;	// The profile that decides which sequences are fused.
+	bool m_profile = false;	// == true if a profile of the run is printed.
+	vector<SourceLine> m_source;	// The source line each word came from, for the profile.
+	string m_profileOut;	// Where to write the execution counts of this run.
+	string m_emitCpp;		// Where to write the program translated into C++.
+	vector<string> m_inputFiles;	// Where READ gets its values from for each run, if not the console.
+	BatchDevice m_batch;	// Reads the input file and holds back output.
+	bool m_shared = false;	// == true if the runs share one copy of the program.
+	bool m_lanes = false;	// == true if the input files are run in lockstep lanes.
+	bool m_sessions = false;	// == true if the input files are run as sessions on one thread.
+	long long m_fuel = 10000;	// The most instructions a session runs in one turn, or a fuzzed run in all.
+	long long m_sessionFuel = 10000000;	// The most a session runs without waiting for input, or 0 for no limit.
+	double m_fuzzSeconds = 0;	// How long to fuzz the program for, or 0 to run it.
+	int m_fuzzThreads = 0;		// The threads that fuzz the program, or 0 for one for each processor.
+	int m_superoptLength = 0;	// The longest sequence the superoptimizer shortens, or 0 for none.
+	bool m_pipe = false;		// == true if the program is run on every record of standard input.
+	streambuf *m_stdoutBuffer = NULL;	// Standard output's buffer, while the listing goes to the error stream.
+	vector<string> m_mapIn;	// The "address:file" windows loaded before the program runs.
+	vector<string> m_mapOut;	// The "address:count:file" windows saved when it ends.
+	bool m_trace = false;	// == true if each instruction is printed as it runs.
+	bool m_checkBounds = false;	// == true if operands are checked against the size of memory.
+	long long m_stepLimit = 0;	// The most instructions the program may run, or 0 for no limit.
+	ExecutionLog m_log;		// The log the run is recorded into or replayed from.
+	string m_recordFile;	// Where to record the run, if anywhere.
+	int m_recordLast = 0;	// The number of instruction addresses kept at the end of the recording.
+	string m_replayFile;	// The recorded run to replay, if any.
+	ResultCache m_cache;	// What the program printed for each input, by key.
+	string m_cacheDirectory;	// Where the cache keeps its files, or empty if there is no cache.
+	int m_cacheEntries = 256;	// The most results the cache keeps in memory.
+	unsigned long long m_imageHash = 0;	// The hash of the program, for the cache's keys.
 };
\ No newline at end of file
@@ -0,0 +1,387 @@
+//
+//		Implementation of the Benchmark class.
+//
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "SharedImage.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+// Swallows everything written to it, so that WRITE costs what formatting the output costs.
+class NullBuffer : public streambuf {
+
+protected:
+
+	int overflow(int a_char) { return a_char; }
+	streamsize xsputn(const char *, streamsize a_count) { return a_count; }
+};
+
+// Puts an instruction into memory.
+static void PutInstruction(Emulator &a_emul, int a_location, int a_opCode, int a_address)
+{
+	a_emul.InsertMemory(a_location, (Emulator::Word)(a_opCode * Emulator::ADDRESS_RADIX + a_address));
+}
+
+// The counts the loops start from, cut down to what a word of the configured type holds. The
+// multiply-accumulate total grows by 6 on each pass, so its count is cut down to a sixth.
+static constexpr long long COUNTING_PASSES = min(500000LL, (long long)Emulator::MAX_WORD);
+static constexpr long long MULTIPLY_PASSES = min(150000LL, (long long)Emulator::MAX_WORD / 6);
+static constexpr long long WRITING_PASSES = min(200000LL, (long long)Emulator::MAX_WORD);
+
+// Counts down from COUNTING_PASSES: LOAD, SUB, STORE and BP, a sequence the threaded engine fuses.
+static void LoadCounting(Emulator &a_emul)
+{
+	PutInstruction(a_emul, 100, Emulator::OP_LOAD, 200);
+	PutInstruction(a_emul, 101, Emulator::OP_SUB, 201);
+	PutInstruction(a_emul, 102, Emulator::OP_STORE, 200);
+	PutInstruction(a_emul, 103, Emulator::OP_BP, 100);
+	PutInstruction(a_emul, 104, Emulator::OP_HALT, 0);
+	a_emul.InsertMemory(200, (Emulator::Word)COUNTING_PASSES);
+	a_emul.InsertMemory(201, 1);
+}
+
+// Adds 3 * 2 to a total MULTIPLY_PASSES times.
+static void LoadMultiplyAccumulate(Emulator &a_emul)
+{
+	PutInstruction(a_emul, 100, Emulator::OP_LOAD, 200);
+	PutInstruction(a_emul, 101, Emulator::OP_MULT, 201);
+	PutInstruction(a_emul, 102, Emulator::OP_ADD, 202);
+	PutInstruction(a_emul, 103, Emulator::OP_STORE, 202);
+	PutInstruction(a_emul, 104, Emulator::OP_LOAD, 203);
+	PutInstruction(a_emul, 105, Emulator::OP_SUB, 204);
+	PutInstruction(a_emul, 106, Emulator::OP_STORE, 203);
+	PutInstruction(a_emul, 107, Emulator::OP_BP, 100);
+	PutInstruction(a_emul, 108, Emulator::OP_HALT, 0);
+	a_emul.InsertMemory(200, 3);
+	a_emul.InsertMemory(201, 2);
+	a_emul.InsertMemory(202, 0);
+	a_emul.InsertMemory(203, (Emulator::Word)MULTIPLY_PASSES);
+	a_emul.InsertMemory(204, 1);
+}
+
+// Fills an array that runs up to 1000 words short of the end of memory, then adds it up. The
+// VC3600 has no index register, so each loop steps through the array by adding one to the
+// address of its own STORE or ADD.
+static void LoadMemorySweep(Emulator &a_emul)
+{
+	const int first = 1000;
+	const int end = Emulator::MEMSZ - 1000;
+
+	PutInstruction(a_emul, 100, Emulator::OP_LOAD, 300);
+	PutInstruction(a_emul, 101, Emulator::OP_STORE, first);
+	PutInstruction(a_emul, 102, Emulator::OP_LOAD, 101);
+	PutInstruction(a_emul, 103, Emulator::OP_ADD, 301);
+	PutInstruction(a_emul, 104, Emulator::OP_STORE, 101);
+	PutInstruction(a_emul, 105, Emulator::OP_SUB, 302);
+	PutInstruction(a_emul, 106, Emulator::OP_BM, 100);
+
+	PutInstruction(a_emul, 107, Emulator::OP_LOAD, 303);
+	PutInstruction(a_emul, 108, Emulator::OP_ADD, first);
+	PutInstruction(a_emul, 109, Emulator::OP_STORE, 303);
+	PutInstruction(a_emul, 110, Emulator::OP_LOAD, 108);
+	PutInstruction(a_emul, 111, Emulator::OP_ADD, 301);
+	PutInstruction(a_emul, 112, Emulator::OP_STORE, 108);
+	PutInstruction(a_emul, 113, Emulator::OP_SUB, 304);
+	PutInstruction(a_emul, 114, Emulator::OP_BM, 107);
+	PutInstruction(a_emul, 115, Emulator::OP_HALT, 0);
+
+	a_emul.InsertMemory(300, 1);
+	a_emul.InsertMemory(301, 1);
+	a_emul.InsertMemory(302, (Emulator::Word)(Emulator::OP_STORE * Emulator::ADDRESS_RADIX + end));
+	a_emul.InsertMemory(304, (Emulator::Word)(Emulator::OP_ADD * Emulator::ADDRESS_RADIX + end));
+}
+
+// Writes a count down from WRITING_PASSES, one WRITE for every four instructions.
+static void LoadWriting(Emulator &a_emul)
+{
+	PutInstruction(a_emul, 100, Emulator::OP_WRITE, 200);
+	PutInstruction(a_emul, 101, Emulator::OP_LOAD, 200);
+	PutInstruction(a_emul, 102, Emulator::OP_SUB, 201);
+	PutInstruction(a_emul, 103, Emulator::OP_STORE, 200);
+	PutInstruction(a_emul, 104, Emulator::OP_BP, 100);
+	PutInstruction(a_emul, 105, Emulator::OP_HALT, 0);
+	a_emul.InsertMemory(200, (Emulator::Word)WRITING_PASSES);
+	a_emul.InsertMemory(201, 1);
+}
+
+// The kernels of the suite.
+static const struct {
+	const char *name;
+	const char *description;
+	void (*load)(Emulator &a_emul);
+} s_kernels[] = {
+	{ "counting", "a counting loop of LOAD, SUB, STORE and BP", LoadCounting },
+	{ "multiply-accumulate", "a loop that multiplies two words and adds to a total", LoadMultiplyAccumulate },
+	{ "memory-sweep", "fills and adds up most of memory through self-modifying STOREs and ADDs", LoadMemorySweep },
+	{ "write-heavy", "a counting loop that WRITEs every count", LoadWriting }
+};
+
+// The engines each kernel is timed on.
+static const struct {
+	const char *name;
+	Emulator::Engine engine;
+	bool fuse;
+	bool fastForward;
+} s_engines[] = {
+	{ "switch", Emulator::ENGINE_SWITCH, false, false },
+	{ "threaded", Emulator::ENGINE_THREADED, false, false },
+	{ "threaded-fused", Emulator::ENGINE_THREADED, true, false },
+	{ "threaded-forward", Emulator::ENGINE_THREADED, false, true },
+	{ "jit", Emulator::ENGINE_JIT, false, false },
+	{ "auto", Emulator::ENGINE_AUTO, false, false }
+};
+
+/*
+Benchmark::RunSuite()
+
+NAME
+
+Benchmark::RunSuite - times every engine on every kernel
+
+SYNOPSIS
+
+void Benchmark::RunSuite(ostream &a_out);
+	a_out -> where the table of results is printed
+
+DESCRIPTION
+
+This function loads each kernel into a new emulator for each engine, so that what one engine
+does to the emulator, such as fusing or translating code, does not carry over to the next. The
+instructions one run executes are counted once for each kernel, and every engine is timed on
+the same count. The kernel's output goes through a BatchDevice into a stream that throws it
+away, and memory goes back to the snapshot of the loaded kernel between runs. Only the runs
+themselves are timed. An engine that fast-forwards skips some of the instructions counted, so
+its row gives the time of a run, and "skipped" in place of the instructions per second.
+*/
+void Benchmark::RunSuite(ostream &a_out)
+{
+	NullBuffer nullBuffer;
+	ostream nullStream(&nullBuffer);
+	m_results.clear();
+
+	a_out << left << setw(22) << "Kernel" << setw(16) << "Engine" << right << setw(14) << "Minstr/s"
+		<< setw(12) << "ns/instr" << setw(12) << "stddev" << setw(12) << "min" << endl;
+	for (size_t kernel = 0; kernel < sizeof(s_kernels) / sizeof(s_kernels[0]); kernel++)
+	{
+		KernelResult result;
+		result.name = s_kernels[kernel].name;
+		result.description = s_kernels[kernel].description;
+		{
+			unique_ptr<Emulator> emul(new Emulator);
+			s_kernels[kernel].load(*emul);
+			result.instructions = CountInstructions(*emul);
+		}
+
+		for (size_t engine = 0; engine < sizeof(s_engines) / sizeof(s_engines[0]); engine++)
+		{
+			unique_ptr<Emulator> emul(new Emulator);
+			BatchDevice device(nullStream);
+			s_kernels[kernel].load(*emul);
+			emul->SetEngine(s_engines[engine].engine);
+			emul->SetFastForward(s_engines[engine].fastForward);
+			if (s_engines[engine].fuse)
+			{
+				emul->FuseInstructions();
+			}
+			emul->SetIODevice(&device);
+			emul->TakeSnapshot();
+
+			Timing timing = TimeEngine(*emul, s_engines[engine].name, result.instructions);
+			timing.skipsInstructions = s_engines[engine].fastForward;
+			a_out << left << setw(22) << result.name << setw(16) << timing.engine << right;
+			if (timing.succeeded && timing.skipsInstructions)
+			{
+				a_out << setw(14) << "skipped" << fixed << setprecision(1) << setw(12) << timing.nsPerRun / 1e3
+					<< " us/run" << endl;
+			}
+			else if (timing.succeeded)
+			{
+				a_out << fixed << setprecision(1) << setw(14) << timing.instructionsPerSecond / 1e6
+					<< setprecision(3) << setw(12) << timing.nsPerInstruction << setw(12) << timing.nsStdDev
+					<< setw(12) << timing.nsMin << endl;
+			}
+			else
+			{
+				a_out << setw(14) << "failed" << endl;
+			}
+			result.timings.push_back(timing);
+		}
+		m_results.push_back(result);
+	}
+}
+
+// Runs the program on an instance of a shared copy of it, one instruction at a time.
+long long Benchmark::CountInstructions(const Emulator &a_emul)
+{
+	ImageInstance instance(make_shared<SharedImage>(a_emul));
+	NullBuffer nullBuffer;
+	ostream nullStream(&nullBuffer);
+	BatchDevice device(nullStream);
+
+	long long count = 1;
+	while (instance.RunSlice(device, 1) == ImageInstance::RUN_PREEMPTED)
+	{
+		count++;
+	}
+	return count;
+}
+
+/*
+Benchmark::TimeEngine()
+
+NAME
+
+Benchmark::TimeEngine - times the runs of a program on one engine
+
+SYNOPSIS
+
+Benchmark::Timing Benchmark::TimeEngine(Emulator &a_emul, const string &a_engine, long long a_instructions);
+	a_emul -> the emulator, with the program loaded, the engine selected and a snapshot taken
+	a_engine -> the name of the engine, for the results
+	a_instructions -> the instructions one run executes
+
+DESCRIPTION
+
+This function runs the program twice to warm up, which also gives the JIT engine the time to
+translate it, and takes the second run's time as a guide to how many runs make a sample of
+SAMPLE_SECONDS. It then times SAMPLES samples of that many runs, and works out the nanoseconds
+per instruction of each.
+
+RETURNS
+
+Returns the mean, standard deviation and least of the nanoseconds per instruction over the
+samples, and the instructions per second at the mean. If a run fails, nothing is timed.
+*/
+Benchmark::Timing Benchmark::TimeEngine(Emulator &a_emul, const string &a_engine, long long a_instructions)
+{
+	Timing timing;
+	timing.engine = a_engine;
+
+	chrono::duration<double> warmUp(0);
+	for (int run = 0; run < 2; run++)
+	{
+		auto start = chrono::steady_clock::now();
+		timing.succeeded = a_emul.RunProgram();
+		warmUp = chrono::steady_clock::now() - start;
+		a_emul.ResetToSnapshot();
+		if (!timing.succeeded)
+		{
+			return timing;
+		}
+	}
+	long long runs = max(1LL, (long long)(SAMPLE_SECONDS / max(warmUp.count(), 1e-9)));
+
+	vector<double> samples;
+	for (int sample = 0; sample < SAMPLES; sample++)
+	{
+		chrono::duration<double> elapsed(0);
+		for (long long run = 0; run < runs; run++)
+		{
+			auto start = chrono::steady_clock::now();
+			timing.succeeded = a_emul.RunProgram();
+			elapsed += chrono::steady_clock::now() - start;
+			a_emul.ResetToSnapshot();
+			if (!timing.succeeded)
+			{
+				return timing;
+			}
+		}
+		samples.push_back(elapsed.count() * 1e9 / ((double)runs * a_instructions));
+	}
+
+	double sum = 0, squares = 0;
+	for (size_t sample = 0; sample < samples.size(); sample++)
+	{
+		sum += samples[sample];
+	}
+	timing.nsPerInstruction = sum / samples.size();
+	for (size_t sample = 0; sample < samples.size(); sample++)
+	{
+		squares += (samples[sample] - timing.nsPerInstruction) * (samples[sample] - timing.nsPerInstruction);
+	}
+	timing.nsStdDev = sqrt(squares / (samples.size() - 1));
+	timing.nsMin = *min_element(samples.begin(), samples.end());
+	timing.instructionsPerSecond = 1e9 / timing.nsPerInstruction;
+	timing.nsPerRun = timing.nsPerInstruction * a_instructions;
+	timing.runs = runs * SAMPLES;
+	return timing;
+}
+
+/*
+Benchmark::WriteJson()
+
+NAME
+
+Benchmark::WriteJson - writes the results of the last suite as JSON
+
+SYNOPSIS
+
+bool Benchmark::WriteJson(const string &a_fileName) const;
+	a_fileName -> the file to write
+
+DESCRIPTION
+
+This function writes one object, with the size of memory and of a word, the samples taken, and
+a list of kernels. Each kernel has its name, description and instruction count, and the timing
+of every engine on it. A run that failed has "succeeded": false and no timing. An engine that
+skips instructions has "skips_instructions": true and only the time of a run, since its times
+per instruction would mean nothing. The names are
+the same from one build to the next, so the file can be compared with one saved earlier.
+
+RETURNS
+
+Returns true if the file was written, false otherwise.
+*/
+bool Benchmark::WriteJson(const string &a_fileName) const
+{
+	ofstream file(a_fileName.c_str(), ios::out | ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+
+	file << "{" << endl;
+	file << "  \"format\": \"vc3600-bench-1\"," << endl;
+	file << "  \"memory_size\": " << Emulator::MEMSZ << "," << endl;
+	file << "  \"word_bytes\": " << sizeof(Emulator::Word) << "," << endl;
+	file << "  \"samples\": " << SAMPLES << "," << endl;
+	file << "  \"kernels\": [" << endl;
+	for (size_t kernel = 0; kernel < m_results.size(); kernel++)
+	{
+		const KernelResult &result = m_results[kernel];
+		file << "    {" << endl;
+		file << "      \"name\": \"" << result.name << "\"," << endl;
+		file << "      \"description\": \"" << result.description << "\"," << endl;
+		file << "      \"instructions\": " << result.instructions << "," << endl;
+		file << "      \"engines\": [" << endl;
+		for (size_t engine = 0; engine < result.timings.size(); engine++)
+		{
+			const Timing &timing = result.timings[engine];
+			file << "        { \"engine\": \"" << timing.engine << "\", \"succeeded\": " << (timing.succeeded ? "true" : "false");
+			if (timing.succeeded && timing.skipsInstructions)
+			{
+				file << fixed << setprecision(0) << ", \"runs\": " << timing.runs
+					<< ", \"skips_instructions\": true, \"ns_per_run\": " << timing.nsPerRun;
+			}
+			else if (timing.succeeded)
+			{
+				file << fixed << setprecision(0) << ", \"runs\": " << timing.runs
+					<< ", \"ns_per_run\": " << timing.nsPerRun
+					<< ", \"instructions_per_second\": " << timing.instructionsPerSecond
+					<< setprecision(4) << ", \"ns_per_instruction\": " << timing.nsPerInstruction
+					<< ", \"ns_per_instruction_stddev\": " << timing.nsStdDev
+					<< ", \"ns_per_instruction_min\": " << timing.nsMin;
+			}
+			file << " }" << (engine + 1 < result.timings.size() ? "," : "") << endl;
+		}
+		file << "      ]" << endl;
+		file << "    }" << (kernel + 1 < m_results.size() ? "," : "") << endl;
+	}
+	file << "  ]" << endl;
+	file << "}" << endl;
+	return (bool)file;
+}
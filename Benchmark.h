@@ -0,0 +1,57 @@
+//
+//		Benchmark class - times the emulator's engines on a set of VC3600 kernels.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Emulator.h"
+
+class Benchmark {
+
+public:
+
+	// How fast one engine ran one kernel.
+	struct Timing {
+		string engine;
+		bool succeeded = false;			// == true if every run of the kernel ended without an error.
+		bool skipsInstructions = false;	// == true if the engine skips loop iterations instead of running them.
+		long long runs = 0;				// The runs timed, over every sample.
+		double nsPerRun = 0;			// The mean time of one run.
+		double instructionsPerSecond = 0;
+		double nsPerInstruction = 0;	// The mean over the samples.
+		double nsStdDev = 0;			// The standard deviation over the samples.
+		double nsMin = 0;				// The fastest sample.
+	};
+
+	// The timings of one kernel on every engine.
+	struct KernelResult {
+		string name;
+		string description;
+		long long instructions = 0;	// The instructions one run of the kernel executes.
+		vector<Timing> timings;
+	};
+
+	// Runs every kernel on every engine, printing a table of the results as it goes.
+	void RunSuite(ostream &a_out);
+
+	// Writes the results as JSON. Returns false if the file could not be written.
+	bool WriteJson(const string &a_fileName) const;
+
+private:
+
+	// The samples timed for each kernel and engine, after a run to warm up.
+	static const int SAMPLES = 7;
+
+	// Each sample repeats the kernel until it has run for at least this long.
+	static constexpr double SAMPLE_SECONDS = 0.05;
+
+	vector<KernelResult> m_results;	// The results of the last suite.
+
+	// Counts the instructions one run of a program executes, one instruction at a time on an
+	// ImageInstance, so that the count does not depend on any of the engines being timed.
+	static long long CountInstructions(const Emulator &a_emul);
+
+	// Times one engine on the program loaded into an emulator.
+	static Timing TimeEngine(Emulator &a_emul, const string &a_engine, long long a_instructions);
+};
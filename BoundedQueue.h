@@ -0,0 +1,59 @@
+//
+//		BoundedQueue class - passes items from one thread to another, holding only so many at a time.
+//
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template <class T>
+class BoundedQueue {
+
+public:
+
+	// Prepares a queue that holds at most a_capacity items.
+	BoundedQueue(size_t a_capacity) : m_capacity(a_capacity) {}
+
+	// Adds an item, waiting while the queue is full.
+	void Push(T a_item)
+	{
+		unique_lock<mutex> lock(m_lock);
+		m_notFull.wait(lock, [this] { return m_items.size() < m_capacity; });
+		m_items.push_back(move(a_item));
+		m_notEmpty.notify_one();
+	}
+
+	// Takes the oldest item, waiting while the queue is empty. Returns false once the queue has
+	// been closed and every item has been taken.
+	bool Pop(T &a_item)
+	{
+		unique_lock<mutex> lock(m_lock);
+		m_notEmpty.wait(lock, [this] { return !m_items.empty() || m_closed; });
+		if (m_items.empty())
+		{
+			return false;
+		}
+		a_item = move(m_items.front());
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	// Notes that no more items will be pushed.
+	void Close()
+	{
+		lock_guard<mutex> lock(m_lock);
+		m_closed = true;
+		m_notEmpty.notify_all();
+	}
+
+private:
+
+	size_t m_capacity;					// The most items held at once.
+	deque<T> m_items;					// The items waiting to be taken, oldest first.
+	bool m_closed = false;				// == true once nothing more will be pushed.
+	mutex m_lock;						// Guards the items and m_closed.
+	condition_variable m_notFull;		// Signalled when an item is taken.
+	condition_variable m_notEmpty;		// Signalled when an item is pushed, or the queue is closed.
+};
@@ -0,0 +1,388 @@
+//
+//		Implementation of the CppTranslator class.
+//
+#include "stdafx.h"
+#include "CppTranslator.h"
+#include <type_traits>
+
+/*
+CppTranslator::Translate()
+
+NAME
+
+CppTranslator::Translate - translates the assembled program into a C++ program
+
+SYNOPSIS
+
+bool CppTranslator::Translate(const string &a_fileName);
+	a_fileName -> the C++ source file to write
+
+DESCRIPTION
+
+This function writes a standalone C++ program that does what the emulator would do with the
+program in its memory. Every instruction becomes a statement with the address as its label,
+in the same order the emulator visits them, so falling through to the next statement is the
+same as moving to the next instruction, and branches become gotos. The words of memory are
+loaded into an array when the program starts.
+
+The translated statements are only correct as long as the instructions they came from are
+unchanged. After every STORE and READ, the word that was written is decoded again, and if it no
+longer decodes to what it was translated from, the program carries on in an interpreter that
+decodes every word as it goes, just as the emulator does. Data words are only checked if the
+emulator could step onto them, since storing a value that looks like an instruction into any
+other word cannot change what the program does. Overflowing STOREs print the same error the
+emulator records and end the program with a status of 1, and so do DIVs by zero.
+
+The instructions are translated before the prologue is written, so that only the helpers they
+call, and only the labels something jumps to, end up in the file, which then compiles without
+warnings about unused functions or labels.
+
+RETURNS
+
+Returns true if the file was written. Returns false if it could not be opened.
+*/
+bool CppTranslator::Translate(const string &a_fileName)
+{
+	ofstream out(a_fileName.c_str());
+	if (!out)
+	{
+		return false;
+	}
+
+	FindWalkedWords();
+
+	// Label every instruction that a branch can land on.
+	vector<bool> isTarget(Emulator::MEMSZ + 1, false);
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(loc), opCode, address);
+		if (opCode >= Emulator::OP_B && opCode <= Emulator::OP_BP)
+		{
+			isTarget[NextInstruction(address)] = true;
+		}
+	}
+
+	// The instructions are translated first, so that the prologue only holds what they use.
+	ostringstream body;
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(loc), opCode, address);
+		if (opCode == 0)
+		{
+			continue;
+		}
+		if (isTarget[loc])
+		{
+			body << "L" << loc << ":" << endl;
+		}
+		WriteInstruction(body, loc, opCode, address);
+	}
+	if (isTarget[Emulator::MEMSZ])
+	{
+		body << "L" << Emulator::MEMSZ << ":" << endl;
+	}
+
+	WritePrologue(out);
+	out << "int main()" << endl;
+	out << "{" << endl;
+	out << "\tfor (size_t i = 0; i < sizeof(s_image) / sizeof(s_image[0]); i++)" << endl;
+	out << "\t{" << endl;
+	out << "\t\ts_memory[s_image[i][0]] = s_image[i][1];" << endl;
+	out << "\t}" << endl;
+	out << endl;
+	out << body.str();
+	out << "\treturn 0;" << endl;
+	out << "}" << endl;
+	return true;
+}
+
+// Marks the words the emulator could step onto: those reached by falling through from the start
+// of memory or from an instruction that is not B or HALT, and those reached by a branch. This only
+// holds while the instructions are unchanged, which is all the translated code relies on.
+void CppTranslator::FindWalkedWords()
+{
+	vector<bool> isTarget(Emulator::MEMSZ + 1, false);
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(loc), opCode, address);
+		if (opCode >= Emulator::OP_B && opCode <= Emulator::OP_BP)
+		{
+			isTarget[address] = true;
+		}
+	}
+
+	m_walked.assign(Emulator::MEMSZ, false);
+	bool fallingThrough = true;
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(loc), opCode, address);
+		if (isTarget[loc])
+		{
+			fallingThrough = true;
+		}
+		m_walked[loc] = fallingThrough;
+		if (opCode == Emulator::OP_B || opCode == Emulator::OP_HALT)
+		{
+			fallingThrough = false;
+		}
+		else if (opCode != 0)
+		{
+			fallingThrough = true;
+		}
+	}
+}
+
+// Finds the first instruction at or after a location, or MEMSZ if there is none.
+int CppTranslator::NextInstruction(int a_location)
+{
+	for (int loc = a_location; loc < Emulator::MEMSZ; loc++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(loc), opCode, address);
+		if (opCode != 0)
+		{
+			return loc;
+		}
+	}
+	return Emulator::MEMSZ;
+}
+
+// The C++ name of the type the emulator's words are held in.
+const char *CppTranslator::WordTypeName()
+{
+	if (is_same<Emulator::Word, short>::value) return "short";
+	if (is_same<Emulator::Word, long>::value) return "long";
+	if (is_same<Emulator::Word, long long>::value) return "long long";
+	return "int";
+}
+
+// The operands and the accumulator are wrapped through the unsigned type that Calculate uses, since
+// signed overflow would let the compiler assume it never happens.
+string CppTranslator::Arithmetic(int a_opCode, const string &a_operand)
+{
+	switch (a_opCode)
+	{
+	case Emulator::OP_ADD:
+		return "(Word)((Bits)s_accumulator + (Bits)" + a_operand + ")";
+	case Emulator::OP_SUB:
+		return "(Word)((Bits)s_accumulator - (Bits)" + a_operand + ")";
+	case Emulator::OP_MULT:
+		return "(Word)((Bits)s_accumulator * (Bits)" + a_operand + ")";
+	default:
+		return "(" + a_operand + " == -1) ? (Word)(0 - (Bits)s_accumulator) : (Word)(s_accumulator / " + a_operand + ")";
+	}
+}
+
+// Writes the memory image, and the decoder and the interpreter that the translated code falls back
+// on if it needs them. The interpreter uses every other helper.
+void CppTranslator::WritePrologue(ostream &a_out)
+{
+	if (m_usesInterpret)
+	{
+		m_usesAccumulator = m_usesRead = m_usesOverflow = m_usesDivideByZero = true;
+	}
+
+	a_out << "//" << endl;
+	a_out << "//\t\tVC3600 program translated into C++ by Assem --emit-cpp." << endl;
+	a_out << "//" << endl;
+	a_out << "#include <iostream>" << endl;
+	a_out << "#include <iomanip>" << endl;
+	a_out << "#include <type_traits>" << endl;
+	a_out << "using namespace std;" << endl;
+	a_out << endl;
+	a_out << "typedef " << WordTypeName() << " Word;" << endl;
+	a_out << "typedef make_unsigned<decltype(Word() + Word())>::type Bits;" << endl;
+	a_out << "static const int MEMSZ = " << Emulator::MEMSZ << ";" << endl;
+	a_out << "static const Word ADDRESS_RADIX = " << Emulator::ADDRESS_RADIX << ";" << endl;
+	a_out << "static const Word MAX_WORD = " << Emulator::MAX_WORD << ";" << endl;
+	a_out << "static Word s_memory[MEMSZ];" << endl;
+	if (m_usesAccumulator)
+	{
+		a_out << "static Word s_accumulator = 0;" << endl;
+	}
+	a_out << endl;
+
+	// Only the words that are not zero need to be listed.
+	a_out << "static const Word s_image[][2] = {" << endl;
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		if (m_emul.GetMemory(loc) != 0)
+		{
+			a_out << "\t{ " << loc << ", " << m_emul.GetMemory(loc) << " }," << endl;
+		}
+	}
+	a_out << "\t{ 0, 0 }" << endl;
+	a_out << "};" << endl;
+	a_out << endl;
+
+	if (m_usesInterpret)
+	{
+		a_out << "// Decodes a word into op code * ADDRESS_RADIX + address, or 0 if it is data or its address" << endl;
+		a_out << "// is outside of memory." << endl;
+		a_out << "static Word Decode(Word a_contents)" << endl;
+		a_out << "{" << endl;
+		a_out << "\tWord opCode = (a_contents >= ADDRESS_RADIX) ? a_contents / ADDRESS_RADIX : 0;" << endl;
+		a_out << "\treturn (opCode >= 1 && opCode <= 13 && a_contents % ADDRESS_RADIX < MEMSZ) ? a_contents : 0;" << endl;
+		a_out << "}" << endl;
+		a_out << endl;
+	}
+	if (m_usesOverflow)
+	{
+		a_out << "// Reports an accumulator that is too big to store." << endl;
+		a_out << "static int Overflow()" << endl;
+		a_out << "{" << endl;
+		a_out << "\tcout << \"" << Emulator::STORE_TOO_BIG_ERROR << "\" << endl;" << endl;
+		a_out << "\treturn 1;" << endl;
+		a_out << "}" << endl;
+		a_out << endl;
+	}
+	if (m_usesDivideByZero)
+	{
+		a_out << "// Reports a division by zero." << endl;
+		a_out << "static int DivideByZero()" << endl;
+		a_out << "{" << endl;
+		a_out << "\tcout << \"" << Emulator::DIVIDE_BY_ZERO_ERROR << "\" << endl;" << endl;
+		a_out << "\treturn 1;" << endl;
+		a_out << "}" << endl;
+		a_out << endl;
+	}
+	if (m_usesRead)
+	{
+		a_out << "// Reads a value from the user." << endl;
+		a_out << "static Word Read()" << endl;
+		a_out << "{" << endl;
+		a_out << "\tWord input;" << endl;
+		a_out << "\tcout << \"? \";" << endl;
+		a_out << "\tcin >> setw(6) >> input;" << endl;
+		a_out << "\treturn input;" << endl;
+		a_out << "}" << endl;
+		a_out << endl;
+	}
+	if (m_usesInterpret)
+	{
+		a_out << "// Runs the program from a location, decoding each word as it goes." << endl;
+		a_out << "static int Interpret(int a_location)" << endl;
+		a_out << "{" << endl;
+		a_out << "\tfor (int loc = a_location; loc < MEMSZ; loc++)" << endl;
+		a_out << "\t{" << endl;
+		a_out << "\t\tWord word = Decode(s_memory[loc]);" << endl;
+		a_out << "\t\tint address = (int)(word % ADDRESS_RADIX);" << endl;
+		a_out << "\t\tswitch ((int)(word / ADDRESS_RADIX))" << endl;
+		a_out << "\t\t{" << endl;
+		for (int opCode = Emulator::OP_ADD; opCode <= Emulator::OP_DIV; opCode++)
+		{
+			a_out << "\t\tcase " << opCode << ": ";
+			if (opCode == Emulator::OP_DIV)
+			{
+				a_out << "if (s_memory[address] == 0) return DivideByZero(); ";
+			}
+			a_out << "s_accumulator = " << Arithmetic(opCode, "s_memory[address]") << "; break;" << endl;
+		}
+		a_out << "\t\tcase 5: s_accumulator = s_memory[address]; break;" << endl;
+		a_out << "\t\tcase 6: if (s_accumulator > MAX_WORD) return Overflow(); s_memory[address] = s_accumulator; break;" << endl;
+		a_out << "\t\tcase 7: s_memory[address] = Read(); break;" << endl;
+		a_out << "\t\tcase 8: cout << s_memory[address] << endl; break;" << endl;
+		a_out << "\t\tcase 9: loc = address - 1; break;" << endl;
+		a_out << "\t\tcase 10: if (s_accumulator < 0) loc = address - 1; break;" << endl;
+		a_out << "\t\tcase 11: if (s_accumulator == 0) loc = address - 1; break;" << endl;
+		a_out << "\t\tcase 12: if (s_accumulator > 0) loc = address - 1; break;" << endl;
+		a_out << "\t\tcase 13: return 0;" << endl;
+		a_out << "\t\t}" << endl;
+		a_out << "\t}" << endl;
+		a_out << "\treturn 0;" << endl;
+		a_out << "}" << endl;
+		a_out << endl;
+	}
+}
+
+// Writes the statement for one instruction, labelled with its location in a comment.
+void CppTranslator::WriteInstruction(ostream &a_out, int a_location, int a_opCode, int a_address)
+{
+	string operand = "s_memory[" + to_string(a_address) + "]";
+
+	a_out << "\t/* " << a_location << " */ ";
+	if (a_opCode != Emulator::OP_READ && a_opCode != Emulator::OP_WRITE && a_opCode != Emulator::OP_B &&
+		a_opCode != Emulator::OP_HALT)
+	{
+		m_usesAccumulator = true;
+	}
+	switch (a_opCode)
+	{
+	case Emulator::OP_ADD:
+		a_out << "s_accumulator = " << Arithmetic(a_opCode, operand) << ";" << endl;
+		break;
+	case Emulator::OP_SUB:
+		a_out << "s_accumulator = " << Arithmetic(a_opCode, operand) << ";" << endl;
+		break;
+	case Emulator::OP_MULT:
+		a_out << "s_accumulator = " << Arithmetic(a_opCode, operand) << ";" << endl;
+		break;
+	case Emulator::OP_DIV:
+		a_out << "if (" << operand << " == 0) return DivideByZero();" << endl;
+		m_usesDivideByZero = true;
+		a_out << "\ts_accumulator = " << Arithmetic(a_opCode, operand) << ";" << endl;
+		break;
+	case Emulator::OP_LOAD:
+		a_out << "s_accumulator = " << operand << ";" << endl;
+		break;
+	case Emulator::OP_STORE:
+		a_out << "if (s_accumulator > MAX_WORD) return Overflow();" << endl;
+		m_usesOverflow = true;
+		a_out << "\t" << operand << " = s_accumulator;" << endl;
+		WriteWordCheck(a_out, a_location, a_address);
+		break;
+	case Emulator::OP_READ:
+		a_out << operand << " = Read();" << endl;
+		m_usesRead = true;
+		WriteWordCheck(a_out, a_location, a_address);
+		break;
+	case Emulator::OP_WRITE:
+		a_out << "cout << " << operand << " << endl;" << endl;
+		break;
+	case Emulator::OP_B:
+		WriteGoto(a_out, a_address);
+		break;
+	case Emulator::OP_BM:
+		a_out << "if (s_accumulator < 0) ";
+		WriteGoto(a_out, a_address);
+		break;
+	case Emulator::OP_BZ:
+		a_out << "if (s_accumulator == 0) ";
+		WriteGoto(a_out, a_address);
+		break;
+	case Emulator::OP_BP:
+		a_out << "if (s_accumulator > 0) ";
+		WriteGoto(a_out, a_address);
+		break;
+	case Emulator::OP_HALT:
+		a_out << "return 0;" << endl;
+		break;
+	}
+}
+
+// After a word has been written, carries on in the interpreter if the word no longer decodes
+// to what it was translated from.
+void CppTranslator::WriteWordCheck(ostream &a_out, int a_location, int a_address)
+{
+	int opCode, address;
+	Emulator::SplitWord(m_emul.GetMemory(a_address), opCode, address);
+	Emulator::Word translated = (opCode != 0) ? m_emul.GetMemory(a_address) : 0;
+
+	if (opCode == 0 && !m_walked[a_address])
+	{
+		return;
+	}
+	a_out << "\tif (Decode(s_memory[" << a_address << "]) != " << translated << ") return Interpret("
+		<< a_location + 1 << ");" << endl;
+	m_usesInterpret = true;
+}
+
+// Writes a jump to the first instruction at or after the address.
+void CppTranslator::WriteGoto(ostream &a_out, int a_address)
+{
+	a_out << "goto L" << NextInstruction(a_address) << ";" << endl;
+}
@@ -0,0 +1,56 @@
+//
+//		CppTranslator class - translates an assembled VC3600 program into a C++ program.
+//
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include "Emulator.h"
+
+class CppTranslator {
+
+public:
+
+	// Prepares to translate the program in the emulator's memory.
+	CppTranslator(const Emulator &a_emul) : m_emul(a_emul) {}
+
+	// Writes the translation to a file.
+	bool Translate(const string &a_fileName);
+
+private:
+
+	const Emulator &m_emul;		// The emulator holding the assembled program.
+	vector<bool> m_walked;		// == true if the emulator could step onto the word.
+
+	// The parts of the prologue the translated instructions use, so that nothing unused is written.
+	bool m_usesAccumulator = false;
+	bool m_usesRead = false;
+	bool m_usesOverflow = false;
+	bool m_usesDivideByZero = false;
+	bool m_usesInterpret = false;
+
+	// Works out which words the emulator could step onto while running the translated code.
+	void FindWalkedWords();
+
+	// Finds the first instruction at or after a location, or MEMSZ if there is none.
+	int NextInstruction(int a_location);
+
+	// The C++ name of the type the emulator's words are held in.
+	static const char *WordTypeName();
+
+	// The C++ expression for what ADD, SUB, MULT or DIV leaves in the accumulator, wrapping around
+	// as Emulator::Calculate does.
+	static string Arithmetic(int a_opCode, const string &a_operand);
+
+	// Writes the fixed part of the program that comes before the translated instructions.
+	void WritePrologue(ostream &a_out);
+
+	// Writes the statement for one instruction.
+	void WriteInstruction(ostream &a_out, int a_location, int a_opCode, int a_address);
+
+	// Writes the code that leaves the translated code if a word no longer holds what was translated.
+	void WriteWordCheck(ostream &a_out, int a_location, int a_address);
+
+	// Writes a jump to the instruction that runs after a branch to an address.
+	void WriteGoto(ostream &a_out, int a_address);
+};
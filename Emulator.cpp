@@ -4,14 +4,28 @@
 #include "stdafx.h"
 #include "Emulator.h"
 #include "Errors.h"
+#include "JitCompiler.h"
+#include "ImageVerifier.h"
+#include "ExecutionLog.h"
 #include <iomanip>
+#include <fstream>
+#include <type_traits>
+#include <algorithm>
+
+// The translated code is released along with the emulator.
+template <int MemorySize, class WordType>
+BasicEmulator<MemorySize, WordType>::~BasicEmulator()
+{
+	delete m_jit;
+}
 
 // Inserts the contents into the location in the VC3600 memory, if possible.
-bool Emulator::InsertMemory(int a_location, int a_contents)
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::InsertMemory(int a_location, Word a_contents)
 {
 	// Check to see if the location and contents are small enough to be put into memory.
 
-	if (a_contents > 999999)
+	if (a_contents > MAX_WORD)
 	{
 		return false;
 	}
@@ -28,10 +42,501 @@ bool Emulator::InsertMemory(int a_location, int a_contents)
 	}
 
 	m_memory[a_location] = a_contents;
+	DecodeWord(a_location);
+	m_verifyPending = true;
+
+	return true;
+}
+
+// Splits a word into its op code and address. Anything that is not a valid instruction
+// is data, which has an op code and address of 0. When the memory size is not a power of ten,
+// the radix leaves room for addresses past the end of memory; a word with one of those, which
+// READ or STORE can make while the program runs, is data too, so no engine ever reads or writes
+// outside of memory.
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::SplitWord(Word a_contents, int &a_opCode, int &a_address)
+{
+	a_opCode = 0;
+	a_address = 0;
+
+	// If it is at least ADDRESS_RADIX, it most likey has an op code.
+	// If not, it is just data.
+	if (a_contents >= ADDRESS_RADIX)
+	{
+		Word opCode = a_contents / ADDRESS_RADIX;
+		Word address = a_contents - (opCode * ADDRESS_RADIX);
+		if (opCode >= 1 && opCode <= 13 && address < MEMSZ)
+		{
+			a_opCode = (int)opCode;
+			a_address = (int)address;
+		}
+	}
+}
+
+// Decodes the word at the location into the decoded memory. Anything that is not
+// a valid instruction is decoded as data, which the emulator skips over.
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::DecodeWord(int a_location)
+{
+	DecodedWord &word = m_decoded[a_location];
+	int oldOpCode = word.opCode;
+
+	SplitWord(m_memory[a_location], word.opCode, word.address);
+
+	if ((word.opCode == 0) != (oldOpCode == 0))
+	{
+		UpdateNextInstruction(a_location);
+	}
+
+	// Fused sequences only depend on op codes, so they only need to be looked at again
+	// if the op code has changed.
+	if (word.opCode != oldOpCode || m_fusedOps == 0)
+	{
+		word.dispatch = word.opCode;
+		for (int loc = a_location - 2; m_fusedOps != 0 && loc <= a_location; loc++)
+		{
+			FuseWord(loc);
+		}
+	}
+
+	// Any native code that was translated from the old word is no longer valid.
+	if (m_jit != NULL)
+	{
+		m_jit->WordChanged(a_location);
+	}
+}
+
+// Points the location, and the run of data just before it, at the first instruction at or
+// after the location. This is how the engines skip over data and empty memory in one step.
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::UpdateNextInstruction(int a_location)
+{
+	int next = (m_decoded[a_location].opCode != 0) ? a_location : m_nextInstruction[a_location + 1];
+
+	m_nextInstruction[a_location] = next;
+	for (int loc = a_location - 1; loc >= 0 && m_decoded[loc].opCode == 0; loc--)
+	{
+		m_nextInstruction[loc] = next;
+	}
+}
+
+// The op codes of each fused sequence, in the order of FusedOp.
+static const int s_fusedSequences[][3] = {
+	{ Emulator::OP_LOAD, Emulator::OP_ADD, Emulator::OP_STORE },
+	{ Emulator::OP_LOAD, Emulator::OP_SUB, Emulator::OP_STORE },
+	{ Emulator::OP_LOAD, Emulator::OP_MULT, Emulator::OP_STORE },
+	{ Emulator::OP_LOAD, Emulator::OP_SUB, Emulator::OP_BM },
+	{ Emulator::OP_LOAD, Emulator::OP_SUB, Emulator::OP_BZ },
+	{ Emulator::OP_LOAD, Emulator::OP_SUB, Emulator::OP_BP }
+};
+
+// Returns the fused sequence that matches the three op codes, or 0 if there is none.
+template <int MemorySize, class WordType>
+int BasicEmulator<MemorySize, WordType>::MatchFusedOp(int a_first, int a_second, int a_third)
+{
+	for (int op = FUSED_LOAD_ADD_STORE; op < FUSED_END; op++)
+	{
+		const int *sequence = s_fusedSequences[op - FUSED_LOAD_ADD_STORE];
+		if (sequence[0] == a_first && sequence[1] == a_second && sequence[2] == a_third)
+		{
+			return op;
+		}
+	}
+	return 0;
+}
+
+// Sets the word's dispatch to the fused sequence that starts there, if that sequence is in use.
+// Only the first word of a sequence changes, so a branch into the middle of one still runs the
+// remaining words one at a time.
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::FuseWord(int a_location)
+{
+	if (a_location < 0 || a_location >= MEMSZ)
+	{
+		return;
+	}
+	DecodedWord &word = m_decoded[a_location];
+	word.dispatch = word.opCode;
+	if (a_location + 2 >= MEMSZ)
+	{
+		return;
+	}
+
+	int op = MatchFusedOp(word.opCode, m_decoded[a_location + 1].opCode, m_decoded[a_location + 2].opCode);
+	if (op != 0 && (m_fusedOps & (1u << (op - FUSED_LOAD_ADD_STORE))) != 0)
+	{
+		word.dispatch = op;
+	}
+}
+
+/*
+Emulator::FuseInstructions()
+
+NAME
+
+Emulator::FuseInstructions - fuses common instruction sequences in the loaded program
+
+SYNOPSIS
+
+void Emulator::FuseInstructions();
+
+DESCRIPTION
+
+This function picks the fused sequences to use and marks the first word of every place in
+memory where one of them occurs, so that the threaded engine runs the three instructions as
+one operation. If a profile has been loaded, a sequence is only used if the places it occurs
+account for at least one percent of the instructions the profiled run executed. Without a
+profile, every sequence is used. The fused words are kept up to date as the program writes
+to memory, so a STORE into one of the instructions turns the sequence back into single steps.
+*/
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::FuseInstructions()
+{
+	long long total = 0;
+	vector<long long> weights(FUSED_END - FUSED_LOAD_ADD_STORE, 0);
+
+	for (int loc = 0; !m_profiler.IsEmpty() && loc + 2 < MEMSZ; loc++)
+	{
+		total += m_profiler.GetExecutions(loc);
+		int op = MatchFusedOp(m_decoded[loc].opCode, m_decoded[loc + 1].opCode, m_decoded[loc + 2].opCode);
+		if (op != 0)
+		{
+			weights[op - FUSED_LOAD_ADD_STORE] += m_profiler.GetExecutions(loc);
+		}
+	}
+
+	m_fusedOps = 0;
+	for (int i = 0; i < (int)weights.size(); i++)
+	{
+		if (m_profiler.IsEmpty() || (weights[i] > 0 && weights[i] * 100 >= total))
+		{
+			m_fusedOps |= 1u << i;
+		}
+	}
+
+	for (int loc = 0; loc < MEMSZ; loc++)
+	{
+		FuseWord(loc);
+	}
+}
+
+// Writes the number of times each executed word was executed, one "location count" per line.
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::SaveProfile(const string &a_fileName)
+{
+	ofstream profile(a_fileName.c_str());
+	if (!profile)
+	{
+		return false;
+	}
+	for (int loc = 0; !m_profiler.IsEmpty() && loc < MEMSZ; loc++)
+	{
+		if (m_profiler.GetExecutions(loc) != 0)
+		{
+			profile << loc << " " << m_profiler.GetExecutions(loc) << endl;
+		}
+	}
+	return true;
+}
+
+// Reads the execution counts that SaveProfile wrote.
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::LoadProfile(const string &a_fileName)
+{
+	ifstream profile(a_fileName.c_str());
+	if (!profile)
+	{
+		return false;
+	}
+	m_profiler.Reset(MEMSZ);
+	int loc;
+	long long count;
+	while (profile >> loc >> count)
+	{
+		if (loc >= 0 && loc < MEMSZ)
+		{
+			m_profiler.SetExecutions(loc, count);
+		}
+	}
+	return true;
+}
+
+// Determines if a file holds raw words rather than text.
+static bool IsBinaryFile(const string &a_fileName)
+{
+	return a_fileName.size() >= 4 && a_fileName.compare(a_fileName.size() - 4, 4, ".bin") == 0;
+}
+
+/*
+Emulator::MapIn()
+
+NAME
+
+Emulator::MapIn - fills a window of memory with the words in a file
+
+SYNOPSIS
+
+bool Emulator::MapIn(int a_location, const string &a_fileName);
+	a_location -> the first word of the window
+	a_fileName -> the file holding the words
+
+DESCRIPTION
+
+This function loads a data set into memory before the program runs, so that the program can
+work through it with LOAD rather than a READ for every word. A file whose name ends in ".bin"
+holds raw words, laid out exactly as memory holds them, so it is read straight into memory
+with no copy in between. Any other file holds integers in text. The words are decoded like any
+other word of memory, so a word that looks like an instruction still runs as one.
+
+RETURNS
+
+Returns true if the file was loaded. Returns false if it could not be read, if it does not fit
+in memory from the location onwards, or if it holds a value that is too big for a word.
+*/
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::MapIn(int a_location, const string &a_fileName)
+{
+	if (a_location < 0 || a_location >= MEMSZ)
+	{
+		return false;
+	}
+
+	int count;
+	if (IsBinaryFile(a_fileName))
+	{
+		ifstream file(a_fileName.c_str(), ios::in | ios::binary | ios::ate);
+		if (!file)
+		{
+			return false;
+		}
+		long long bytes = file.tellg();
+		if (bytes % sizeof(Word) != 0 || bytes / (long long)sizeof(Word) > MEMSZ - a_location)
+		{
+			return false;
+		}
+		count = (int)(bytes / sizeof(Word));
+		file.seekg(0);
+		if (!file.read((char *)&m_memory[a_location], bytes))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		string text;
+		vector<long long> values;
+		if (!ReadWholeFile(a_fileName, text))
+		{
+			return false;
+		}
+		ParseIntegers(text.data(), text.size(), values);
+		if (values.size() > (size_t)(MEMSZ - a_location))
+		{
+			return false;
+		}
+		count = (int)values.size();
+		for (int i = 0; i < count; i++)
+		{
+			if (values[i] < numeric_limits<Word>::min() || values[i] > MAX_WORD)
+			{
+				return false;
+			}
+		}
+		copy(values.begin(), values.end(), m_memory.begin() + a_location);
+	}
 
+	// Raw words are only checked once they are in memory. Any that are too big are still
+	// decoded, so that memory and the decoded memory agree.
+	DecodeWords(a_location, count);
+	for (int loc = a_location; loc < a_location + count; loc++)
+	{
+		if (m_memory[loc] > MAX_WORD)
+		{
+			return false;
+		}
+	}
 	return true;
 }
 
+// Records a window of memory to write to a file when the program ends.
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::MapOut(int a_location, int a_count, const string &a_fileName)
+{
+	if (a_location < 0 || a_count < 0 || a_count > MEMSZ - a_location)
+	{
+		return false;
+	}
+	MapWindow window;
+	window.location = a_location;
+	window.count = a_count;
+	window.fileName = a_fileName;
+	m_mapOut.push_back(window);
+	return true;
+}
+
+// Writes each MapOut window to its file, as raw words or as one integer per line.
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::SaveMapOut()
+{
+	for (size_t i = 0; i < m_mapOut.size(); i++)
+	{
+		const MapWindow &window = m_mapOut[i];
+		ofstream file;
+		if (IsBinaryFile(window.fileName))
+		{
+			file.open(window.fileName.c_str(), ios::out | ios::binary);
+			file.write((const char *)&m_memory[window.location], window.count * sizeof(Word));
+		}
+		else
+		{
+			file.open(window.fileName.c_str(), ios::out);
+			for (int loc = window.location; loc < window.location + window.count; loc++)
+			{
+				file << m_memory[loc] << "\n";
+			}
+		}
+		if (!file)
+		{
+			Errors::RecordError("ERROR: Memory could not be written to " + window.fileName + "!");
+			return false;
+		}
+	}
+	return true;
+}
+
+// Decodes a run of words that was copied into memory all at once. Each word is split on its
+// own, and then the next instruction table, the fused sequences and any translated code are
+// brought up to date for the whole run, rather than once for every word as DecodeWord does.
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::DecodeWords(int a_location, int a_count)
+{
+	int end = a_location + a_count;
+	for (int loc = a_location; loc < end; loc++)
+	{
+		DecodedWord &word = m_decoded[loc];
+		SplitWord(m_memory[loc], word.opCode, word.address);
+		word.dispatch = word.opCode;
+	}
+
+	// Rebuild the table backwards from the end of the run, through the data just before it.
+	int next = m_nextInstruction[end];
+	for (int loc = end - 1; loc >= 0; loc--)
+	{
+		if (m_decoded[loc].opCode != 0)
+		{
+			if (loc < a_location)
+			{
+				break;
+			}
+			next = loc;
+		}
+		m_nextInstruction[loc] = next;
+	}
+
+	for (int loc = a_location - 2; m_fusedOps != 0 && loc < end; loc++)
+	{
+		FuseWord(loc);
+	}
+	for (int loc = a_location; m_jit != NULL && loc < end; loc++)
+	{
+		m_jit->WordChanged(loc);
+	}
+	m_verifyPending = true;
+}
+
+/*
+Emulator::TakeSnapshot()
+
+NAME
+
+Emulator::TakeSnapshot - remembers the contents of memory
+
+SYNOPSIS
+
+void Emulator::TakeSnapshot();
+
+DESCRIPTION
+
+This function copies memory so that the same loaded program can be run again and again by
+calling ResetToSnapshot between runs. From now on, every word a run may write is marked dirty:
+WriteMemory marks the words it writes, a verified program marks the words the verifier found it
+can write, and the JIT marks the operand of every STORE it translates. Only the dirty words
+need to be put back, so a reset costs time in proportion to what the run touched rather than
+to the size of memory.
+*/
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::TakeSnapshot()
+{
+	m_snapshot = m_memory;
+	for (size_t i = 0; i < m_dirtyWords.size(); i++)
+	{
+		m_dirty[m_dirtyWords[i]] = 0;
+	}
+	m_dirtyWords.clear();
+	if (m_jit != NULL)
+	{
+		m_jit->MarkStoreTargets();
+	}
+}
+
+// Puts back every dirty word that differs from the snapshot, decoding it again.
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::ResetToSnapshot()
+{
+	for (size_t i = 0; i < m_dirtyWords.size(); i++)
+	{
+		int loc = m_dirtyWords[i];
+		m_dirty[loc] = 0;
+		if (m_memory[loc] != m_snapshot[loc])
+		{
+			m_memory[loc] = m_snapshot[loc];
+			DecodeWord(loc);
+		}
+	}
+	m_dirtyWords.clear();
+
+	// Translated code that is kept can still store without going through WriteMemory.
+	if (m_jit != NULL)
+	{
+		m_jit->MarkStoreTargets();
+	}
+}
+
+// The instrumentation compiled into each variant of RunSwitched. The flags are compile-time
+// constants, so a variant has no code at all for the features it leaves out. With VC_NO_PROFILER
+// defined, no variant profiles. Skipping loop iterations would hide them from every kind of
+// instrumentation, so only ForwardRun fast-forwards, and it is run only when fast-forwarding
+// is turned on.
+struct PlainRun {
+	static const bool TRACE = false;
+	static const bool PROFILE = false;
+	static const bool LIMIT_STEPS = false;
+	static const bool CHECK_BOUNDS = false;
+	static const bool KEEP_ADDRESSES = false;
+	static const bool FAST_FORWARD = false;
+};
+struct ForwardRun : PlainRun {
+	static const bool FAST_FORWARD = true;
+};
+struct ProfiledRun : PlainRun {
+	static const bool PROFILE = VC_PROFILER != 0;
+};
+struct CheckedRun : PlainRun {
+	static const bool LIMIT_STEPS = true;
+	static const bool CHECK_BOUNDS = true;
+};
+struct AddressRingRun : PlainRun {
+	static const bool KEEP_ADDRESSES = true;
+};
+struct InstrumentedRun {
+	static const bool TRACE = true;
+	static const bool PROFILE = VC_PROFILER != 0;
+	static const bool LIMIT_STEPS = true;
+	static const bool CHECK_BOUNDS = true;
+	static const bool KEEP_ADDRESSES = true;
+	static const bool FAST_FORWARD = false;
+};
+
 /*
 Emulator::RunProgram()
 
@@ -47,35 +552,184 @@ bool Emulator::RunProgram();
 DESCRIPTION
 
 This function runs the program that is stored in the memory of the VC3600 emulator. It goes
-through any possible addresses with values/instructions stored in them until an "end" value is hit,
-in which case it will end. Hence the class name, it is emulating how a VC3600 would run a program stored
-in its memory.
+through any possible addresses with instructions stored in them until an "end" value is hit,
+in which case it will end. Data and empty memory are skipped in one step. Hence the class
+name, it is emulating how a VC3600 would run a program stored in its memory.
+
+If any instrumentation is turned on, the program runs on the variant of the switch engine
+that has the least instrumentation compiled in that still covers what was asked for.
+Otherwise the work is handed to the engine selected with SetEngine, and the switch engine
+runs without any instrumentation code, and with the code that skips loops ahead only if
+SetFastForward turned it on. ENGINE_AUTO verifies the program the first time it is run
+after being loaded (see VerifyImage). A program that passes runs on the threaded engine with
+every check left out. One that does not pass runs on the switch engine, which checks everything.
+READ and WRITE go through the I/O device set with SetIODevice, which is flushed at the end.
+If an ExecutionLog is recording, every value READ gets is logged, and if one is replaying, READ
+takes its values from the log instead of the device. Either way, the log is told how the run
+ended. If the program ends without an error, the MapOut windows are written to their files.
 
 RETURNS
 
 Returns true if the program ran successfully without any errors being encountered. Returns false
 if there was an error that caused the program to stop running.
 */
-bool Emulator::RunProgram()
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::RunProgram()
 {
 	InitEmulator();
+	bool result = RunSelectedEngine();
+	if (m_log != NULL && m_log->IsActive())
+	{
+		m_log->EndRun(result, m_currentAddress, m_accumulator);
+	}
+
+	// Output that the I/O device held back is sent once the program stops, however it stopped.
+	m_io->Flush();
+	if (result && !m_mapOut.empty())
+	{
+		result = SaveMapOut();
+	}
+	return result;
+}
 
-	while (m_currentAddress < MEMSZ)
+// Runs the program on the engine RunProgram settled on.
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::RunSelectedEngine()
+{
+	bool checking = m_boundsChecking || m_stepLimit != 0;
+	bool keepAddresses = m_log != NULL && m_log->KeepsAddresses();
+	if (m_tracing || (int)m_profiling + (int)checking + (int)keepAddresses > 1)
+	{
+		return RunSwitched<InstrumentedRun>();
+	}
+	if (m_profiling)
+	{
+		return RunSwitched<ProfiledRun>();
+	}
+	if (checking)
 	{
-		if (m_memory[m_currentAddress] != NULL)
+		return RunSwitched<CheckedRun>();
+	}
+	if (keepAddresses)
+	{
+		return RunSwitched<AddressRingRun>();
+	}
+
+	if (m_engine == ENGINE_AUTO)
+	{
+		if (m_verifyPending)
 		{
-			// First, check to see what kind of data is stored here.
-			// If it is greater than 9999, it most likey has an op code.
-			// If not, it is just data.
-			if (m_memory[m_currentAddress] > 9999)
+			vector<string> problems;
+			VerifyImage(problems);
+		}
+		if (m_verified)
+		{
+			return RunVerified();
+		}
+	}
+	if (m_engine == ENGINE_THREADED)
+	{
+		return RunThreaded<true>();
+	}
+	if (m_engine == ENGINE_JIT)
+	{
+		return RunJit();
+	}
+	if (m_fastForward)
+	{
+		return RunSwitched<ForwardRun>();
+	}
+	return RunSwitched<PlainRun>();
+}
+
+// Runs the ImageVerifier over memory and remembers whether the program passed.
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::VerifyImage(vector<string> &a_problems)
+{
+	ImageVerifier verifier(*this);
+	m_verified = verifier.Verify();
+	m_verifyPending = false;
+	m_writtenWords = verifier.GetWrittenWords();
+	a_problems = verifier.GetProblems();
+	return m_verified;
+}
+
+// Runs the program by visiting each word in turn and performing its action.
+template <int MemorySize, class WordType>
+template <class Policy>
+bool BasicEmulator<MemorySize, WordType>::RunSwitched()
+{
+	long long steps = 0;
+	bool keepAddresses = m_log != NULL && m_log->KeepsAddresses();
+
+	for (;;)
+	{
+		// Skip straight over any data or empty memory to the next instruction.
+		m_currentAddress = m_nextInstruction[m_currentAddress];
+		if (m_currentAddress == MEMSZ)
+		{
+			break;
+		}
+
+		const DecodedWord &word = m_decoded[m_currentAddress];
+		int location = m_currentAddress;
+		int opCode = word.opCode;
+		if constexpr (Policy::TRACE)
+		{
+			if (m_tracing)
 			{
-				int data = m_memory[m_currentAddress];
-				int opCode = data / 10000;
-				int address = data - (opCode * 10000);
-				if (!PerformAction(opCode, address))
-				{
-					return false;
-				}
+				cerr << m_currentAddress << "\t" << word.opCode << "\t" << word.address << "\t" << m_accumulator << endl;
+			}
+		}
+		if constexpr (Policy::PROFILE)
+		{
+			if (m_profiling)
+			{
+				m_profiler.CountStep(location, opCode, word.address);
+			}
+		}
+		if constexpr (Policy::KEEP_ADDRESSES)
+		{
+			if (keepAddresses)
+			{
+				m_log->AddAddress(location);
+			}
+		}
+		if constexpr (Policy::LIMIT_STEPS)
+		{
+			if (m_stepLimit != 0 && ++steps > m_stepLimit)
+			{
+				Errors::RecordError("ERROR: Step limit exceeded!");
+				return false;
+			}
+		}
+		if constexpr (Policy::CHECK_BOUNDS)
+		{
+			if (m_boundsChecking && (word.address < 0 || word.address >= MEMSZ))
+			{
+				Errors::RecordError("ERROR: Operand address is outside of memory!");
+				return false;
+			}
+		}
+
+		if (!PerformAction(opCode, word.address))
+		{
+			return false;
+		}
+		if constexpr (Policy::PROFILE)
+		{
+			if (m_profiling && opCode >= OP_B && opCode <= OP_BP)
+			{
+				m_profiler.CountBranch(location, BranchTaken(opCode, m_accumulator), word.address);
+			}
+		}
+		if constexpr (Policy::FAST_FORWARD)
+		{
+			// A branch that was taken back to or before itself closes a loop.
+			if (opCode >= OP_B && opCode <= OP_BP && m_currentAddress < location &&
+				m_rejectedLoops[location] != m_runNumber)
+			{
+				ForwardLoop(location, m_currentAddress + 1, m_accumulator);
 			}
 		}
 
@@ -86,10 +740,14 @@ bool Emulator::RunProgram()
 }
 
 // Initializes the accumulator and current address in the emulator.
-void Emulator::InitEmulator()
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::InitEmulator()
 {
 	m_accumulator = 0;
 	m_currentAddress = 0;
+
+	// Loops that ForwardLoop found not to fit in the last run are looked at again.
+	m_runNumber++;
 }
 
 /*
@@ -115,65 +773,56 @@ stored in that case on the value stored at the address that is passed into the f
 RETURNS
 
 Returns true upon a successful operation, returns false is there was some sort of error
-during the operation (accumulator/value in memory becoming too large to be stored in memory).
+during the operation (accumulator/value in memory becoming too large to be stored in memory,
+or a division by zero).
 */
-bool Emulator::PerformAction(int a_opCode, int a_address)
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::PerformAction(int a_opCode, int a_address)
 {
 	switch (a_opCode)
 	{
 	case 1: // ADD
-		m_accumulator = m_accumulator + m_memory[a_address];
+		m_accumulator = Calculate(OP_ADD, m_accumulator, m_memory[a_address]);
 		break;
 	case 2: // SUB
-		m_accumulator = m_accumulator - m_memory[a_address];
+		m_accumulator = Calculate(OP_SUB, m_accumulator, m_memory[a_address]);
 		break;
 	case 3: // MULT
-		m_accumulator = m_accumulator * m_memory[a_address];
+		m_accumulator = Calculate(OP_MULT, m_accumulator, m_memory[a_address]);
 		break;
 	case 4: // DIV
-		m_accumulator = m_accumulator / m_memory[a_address];
+		if (!CanDivide(m_memory[a_address]))
+		{
+			Errors::RecordError(DIVIDE_BY_ZERO_ERROR);
+			return false;
+		}
+		m_accumulator = Calculate(OP_DIV, m_accumulator, m_memory[a_address]);
 		break;
 	case 5: // LOAD
 		m_accumulator = m_memory[a_address];
 		break;
 	case 6: // STORE
-		if (m_accumulator > 999999)
+		if (!CanStore(m_accumulator))
 		{
-			// The accumulator's value is too big to store in memory.
-			Errors::RecordError("ERROR: Accumulator's value is too big to store in memory!");
+			Errors::RecordError(STORE_TOO_BIG_ERROR);
 			return false;
 		}
 		else
 		{
-			m_memory[a_address] = m_accumulator;
+			WriteMemory(a_address, m_accumulator);
 		}
 		break;
 	case 7: // READ
-		int input;
-		cout << "? ";
-		cin >> setw(6) >> input;
-		m_memory[a_address] = input;
+		WriteMemory(a_address, ReadInput());
 		break;
 	case 8: // WRITE
-		cout << m_memory[a_address] << endl;
+		WriteOutput(m_memory[a_address]);
 		break;
 	case 9: // BRANCH
-		m_currentAddress = a_address - 1;
-		break;
 	case 10: // BRANCH MINUS
-		if (m_accumulator < 0)
-		{
-			m_currentAddress = a_address - 1;
-		}
-		break;
 	case 11: // BRANCH ZERO
-		if (m_accumulator == 0)
-		{
-			m_currentAddress = a_address - 1;
-		}
-		break;
 	case 12: // BRANCH POSITIVE
-		if (m_accumulator > 0)
+		if (BranchTaken(a_opCode, m_accumulator))
 		{
 			m_currentAddress = a_address - 1;
 		}
@@ -186,3 +835,553 @@ bool Emulator::PerformAction(int a_opCode, int a_address)
 	}
 	return true;
 }
+
+/*
+Emulator::RunThreaded()
+
+NAME
+
+Emulator::RunThreaded - runs the program in memory with threaded dispatch
+
+SYNOPSIS
+
+template <bool CHECKED> bool Emulator::RunThreaded();
+
+DESCRIPTION
+
+This function runs the same program as RunSwitched, but instead of returning to a loop
+after every word, each instruction's handler jumps straight to the handler of the next one
+through a table of label addresses (a GCC/Clang extension). On other compilers, or when
+VC_NO_COMPUTED_GOTO is defined, the handlers are reached through a switch instead, which
+still avoids the call to PerformAction. The accumulator and current address are kept in
+locals while the program runs. The word past the end of memory is decoded as OP_END, so
+no bounds check is needed per step. Landing on data jumps straight to the next instruction
+through the next instruction table. Words that start a fused sequence (see FuseInstructions)
+run the whole sequence in one handler. With fast-forwarding turned on, a branch taken back to
+or before itself gives ForwardLoop the chance to skip ahead before the jump.
+
+When CHECKED is false, the words the program writes are not decoded again and DIV does not check
+for a zero divisor. This is only correct for a program that has passed VerifyImage, and is how
+RunVerified runs one.
+
+RETURNS
+
+Returns true if the program ran successfully without any errors being encountered. Returns false
+if there was an error that caused the program to stop running.
+*/
+template <int MemorySize, class WordType>
+template <bool CHECKED>
+bool BasicEmulator<MemorySize, WordType>::RunThreaded()
+{
+	Word *memory = m_memory.data();
+	const DecodedWord *decoded = m_decoded.data();
+	const int *nextInstruction = m_nextInstruction.data();
+	Word accumulator = m_accumulator;
+	int address = m_currentAddress;
+	int operand = 0;
+	bool fastForward = m_fastForward;
+	const unsigned *rejectedLoops = m_rejectedLoops.data();
+
+#if defined(__GNUC__) && !defined(VC_NO_COMPUTED_GOTO)
+	static void *const handlers[] = {
+		&&L_OP_DATA, &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MULT, &&L_OP_DIV, &&L_OP_LOAD, &&L_OP_STORE,
+		&&L_OP_READ, &&L_OP_WRITE, &&L_OP_B, &&L_OP_BM, &&L_OP_BZ, &&L_OP_BP, &&L_OP_HALT, &&L_OP_END,
+		&&L_FUSED_LOAD_ADD_STORE, &&L_FUSED_LOAD_SUB_STORE, &&L_FUSED_LOAD_MULT_STORE,
+		&&L_FUSED_LOAD_SUB_BM, &&L_FUSED_LOAD_SUB_BZ, &&L_FUSED_LOAD_SUB_BP
+	};
+#define HANDLER(op) L_##op
+#define DISPATCH() operand = decoded[address].address; goto *handlers[decoded[address].dispatch]
+#else
+#define HANDLER(op) case op
+#define DISPATCH() continue
+#endif
+#define NEXT() address++; DISPATCH()
+#define JUMP(target) address = (target); DISPATCH()
+#define BRANCH(target) \
+	if (fastForward && (target) <= address && rejectedLoops[address] != m_runNumber) \
+	{ \
+		ForwardLoop(address, (target), accumulator); \
+	} \
+	JUMP(target)
+#define STORE(target) \
+	if (!CanStore(accumulator)) \
+	{ \
+		Errors::RecordError(STORE_TOO_BIG_ERROR); \
+		m_accumulator = accumulator; \
+		m_currentAddress = address; \
+		return false; \
+	} \
+	WRITE_WORD(target, accumulator)
+#define WRITE_WORD(target, value) \
+	if constexpr (CHECKED) \
+	{ \
+		WriteMemory(target, value); \
+	} \
+	else \
+	{ \
+		memory[target] = value; \
+	}
+#define SECOND_OPERAND memory[decoded[address + 1].address]
+
+#if defined(__GNUC__) && !defined(VC_NO_COMPUTED_GOTO)
+	DISPATCH();
+	{
+		{
+#else
+	for (;;)
+	{
+		operand = decoded[address].address;
+		switch (decoded[address].dispatch)
+		{
+#endif
+		HANDLER(OP_DATA):
+			JUMP(nextInstruction[address]);
+		HANDLER(OP_ADD):
+			accumulator = Calculate(OP_ADD, accumulator, memory[operand]);
+			NEXT();
+		HANDLER(OP_SUB):
+			accumulator = Calculate(OP_SUB, accumulator, memory[operand]);
+			NEXT();
+		HANDLER(OP_MULT):
+			accumulator = Calculate(OP_MULT, accumulator, memory[operand]);
+			NEXT();
+		HANDLER(OP_DIV):
+			if constexpr (CHECKED)
+			{
+				if (!CanDivide(memory[operand]))
+				{
+					Errors::RecordError(DIVIDE_BY_ZERO_ERROR);
+					m_accumulator = accumulator;
+					m_currentAddress = address;
+					return false;
+				}
+			}
+			accumulator = Calculate(OP_DIV, accumulator, memory[operand]);
+			NEXT();
+		HANDLER(OP_LOAD):
+			accumulator = memory[operand];
+			NEXT();
+		HANDLER(OP_STORE):
+			STORE(operand);
+			NEXT();
+		HANDLER(OP_READ):
+			// An ExecutionLog notes where each READ happened.
+			m_accumulator = accumulator;
+			m_currentAddress = address;
+			WRITE_WORD(operand, ReadInput());
+			NEXT();
+		HANDLER(OP_WRITE):
+			WriteOutput(memory[operand]);
+			NEXT();
+		HANDLER(OP_B):
+			BRANCH(operand);
+		HANDLER(OP_BM):
+			if (BranchTaken(OP_BM, accumulator))
+			{
+				BRANCH(operand);
+			}
+			NEXT();
+		HANDLER(OP_BZ):
+			if (BranchTaken(OP_BZ, accumulator))
+			{
+				BRANCH(operand);
+			}
+			NEXT();
+		HANDLER(OP_BP):
+			if (BranchTaken(OP_BP, accumulator))
+			{
+				BRANCH(operand);
+			}
+			NEXT();
+		HANDLER(OP_HALT):
+		HANDLER(OP_END):
+			m_accumulator = accumulator;
+			m_currentAddress = MEMSZ;
+			return true;
+
+		// The fused sequences. The last word's operand is read once the address has moved
+		// onto it, so that an error is reported at the instruction that caused it.
+		HANDLER(FUSED_LOAD_ADD_STORE):
+			accumulator = Calculate(OP_ADD, memory[operand], SECOND_OPERAND);
+			address += 2;
+			STORE(decoded[address].address);
+			NEXT();
+		HANDLER(FUSED_LOAD_SUB_STORE):
+			accumulator = Calculate(OP_SUB, memory[operand], SECOND_OPERAND);
+			address += 2;
+			STORE(decoded[address].address);
+			NEXT();
+		HANDLER(FUSED_LOAD_MULT_STORE):
+			accumulator = Calculate(OP_MULT, memory[operand], SECOND_OPERAND);
+			address += 2;
+			STORE(decoded[address].address);
+			NEXT();
+		HANDLER(FUSED_LOAD_SUB_BM):
+			accumulator = Calculate(OP_SUB, memory[operand], SECOND_OPERAND);
+			address += 2;
+			if (BranchTaken(OP_BM, accumulator))
+			{
+				BRANCH(decoded[address].address);
+			}
+			NEXT();
+		HANDLER(FUSED_LOAD_SUB_BZ):
+			accumulator = Calculate(OP_SUB, memory[operand], SECOND_OPERAND);
+			address += 2;
+			if (BranchTaken(OP_BZ, accumulator))
+			{
+				BRANCH(decoded[address].address);
+			}
+			NEXT();
+		HANDLER(FUSED_LOAD_SUB_BP):
+			accumulator = Calculate(OP_SUB, memory[operand], SECOND_OPERAND);
+			address += 2;
+			if (BranchTaken(OP_BP, accumulator))
+			{
+				BRANCH(decoded[address].address);
+			}
+			NEXT();
+		}
+	}
+#undef HANDLER
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef BRANCH
+#undef STORE
+#undef WRITE_WORD
+#undef SECOND_OPERAND
+}
+
+// A value in the body of a loop: a multiple of what a word that the body stores into held at the
+// start of the iteration, plus a constant. With no word, the value is just the constant.
+struct LoopValue {
+	int cell;				// The word, or -1 for none.
+	long long coefficient;	// What the word's value is multiplied by.
+	long long constant;		// What is added to it.
+};
+
+// The answer for a bound that is never reached.
+static const long long NEVER = numeric_limits<long long>::max();
+
+// Gets the first iteration, counting from 0, in which a value that starts at a_base and changes
+// by a_step with each iteration is above a_limit.
+static long long FirstIterationAbove(long long a_base, long long a_step, long long a_limit)
+{
+	if (a_base > a_limit)
+	{
+		return 0;
+	}
+	return (a_step <= 0) ? NEVER : (a_limit - a_base) / a_step + 1;
+}
+
+// Gets the first iteration in which such a value is below a_limit.
+static long long FirstIterationBelow(long long a_base, long long a_step, long long a_limit)
+{
+	return FirstIterationAbove(-a_base, -a_step, -a_limit);
+}
+
+/*
+Emulator::ForwardLoop()
+
+NAME
+
+Emulator::ForwardLoop - skips the iterations of a simple loop that cannot end it
+
+SYNOPSIS
+
+bool Emulator::ForwardLoop(int a_branch, int a_target, Word &a_accumulator);
+	a_branch -> the branch that closes the loop, which has just been taken
+	a_target -> where it goes back to, the start of the loop
+	a_accumulator -> the accumulator, which is set to what it would be after the skipped iterations
+
+DESCRIPTION
+
+This function is called when a branch has been taken back to the start of a loop. It looks for a
+loop whose body only LOADs, ADDs, SUBs and STOREs, LOADs before it uses the accumulator, and does
+not store into its own code. Every word such a loop stores into must end each iteration holding
+what it held at the start plus a constant: a counter that is counted down, or a total that a
+constant is added to. The other words it reads do not change while it runs. Everything the
+accumulator holds in an iteration then changes by a constant from one iteration to the next,
+so working through the body once is enough to tell in which iteration the branch is first not
+taken, a STORE would first find the accumulator too big, or any value would first overflow a
+word. The iterations before all of those are skipped by adding their changes to memory all at
+once, and the engine goes on stepping from the first one that is left. That iteration and
+everything after it run as they always do, so an error is reported at the same instruction and
+with the same state as if every iteration had been stepped.
+
+A loop that does not have the right shape is remembered in m_rejectedLoops, and the engines do
+not call this function for it again in the same run.
+
+RETURNS
+
+Returns true if any iterations were skipped, false otherwise.
+*/
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::ForwardLoop(int a_branch, int a_target, Word &a_accumulator)
+{
+	const int MAX_BODY = 32;
+	int cells[MAX_BODY];			// The words the body stores into.
+	LoopValue values[MAX_BODY];		// What each of them holds, as the body is worked through.
+	long long deltas[MAX_BODY];		// How much each of them changes in an iteration.
+	LoopValue results[MAX_BODY];	// What the accumulator holds after each instruction.
+	bool stored[MAX_BODY];			// == true if the instruction is a STORE.
+	int cellCount = 0, count = 0;
+
+	// Find the words the body stores into, making sure that it does nothing else it may not.
+	for (int loc = m_nextInstruction[a_target]; loc < a_branch; loc = m_nextInstruction[loc + 1])
+	{
+		const DecodedWord &word = m_decoded[loc];
+		bool fits = (word.opCode == OP_LOAD || word.opCode == OP_ADD || word.opCode == OP_SUB ||
+			word.opCode == OP_STORE) && word.address >= 0 && word.address < MEMSZ && count < MAX_BODY;
+		if (fits && word.opCode == OP_STORE)
+		{
+			fits = word.address < a_target || word.address > a_branch;
+			if (find(cells, cells + cellCount, word.address) == cells + cellCount)
+			{
+				values[cellCount].cell = word.address;
+				values[cellCount].coefficient = 1;
+				values[cellCount].constant = 0;
+				cells[cellCount++] = word.address;
+			}
+		}
+		if (!fits)
+		{
+			m_rejectedLoops[a_branch] = m_runNumber;
+			return false;
+		}
+		count++;
+	}
+
+	// Work through the body once, keeping track of what each value is made of.
+	LoopValue accumulator = { -1, 0, 0 };
+	bool loaded = false, fits = true;
+	count = 0;
+	for (int loc = m_nextInstruction[a_target]; loc < a_branch && fits; loc = m_nextInstruction[loc + 1])
+	{
+		const DecodedWord &word = m_decoded[loc];
+		int cell = (int)(find(cells, cells + cellCount, word.address) - cells);
+		LoopValue operand = { -1, 0, (long long)m_memory[word.address] };
+		if (cell < cellCount)
+		{
+			operand = values[cell];
+		}
+
+		if (word.opCode == OP_LOAD)
+		{
+			accumulator = operand;
+			loaded = true;
+		}
+		else if (!loaded)
+		{
+			fits = false;
+		}
+		else if (word.opCode == OP_STORE)
+		{
+			values[cell] = accumulator;
+		}
+		else if (operand.coefficient != 0 && accumulator.coefficient != 0 && operand.cell != accumulator.cell)
+		{
+			fits = false;
+		}
+		else
+		{
+			long long sign = (word.opCode == OP_ADD) ? 1 : -1;
+			if (operand.coefficient != 0)
+			{
+				accumulator.cell = operand.cell;
+			}
+			accumulator.coefficient += sign * operand.coefficient;
+			accumulator.constant += sign * operand.constant;
+		}
+		stored[count] = (word.opCode == OP_STORE);
+		results[count++] = accumulator;
+	}
+
+	// Every word stored into must have gone up or down by a constant.
+	for (int cell = 0; cell < cellCount && fits; cell++)
+	{
+		fits = values[cell].cell == cells[cell] && values[cell].coefficient == 1;
+		deltas[cell] = values[cell].constant;
+	}
+	if (!fits || !loaded)
+	{
+		m_rejectedLoops[a_branch] = m_runNumber;
+		return false;
+	}
+
+	// Find the first iteration that could end the loop or be an error, and the accumulator's
+	// value and step at the branch.
+	long long iterations = NEVER, base = 0, step = 0;
+	for (int i = 0; i < count; i++)
+	{
+		base = results[i].constant;
+		step = 0;
+		if (results[i].coefficient != 0)
+		{
+			int cell = (int)(find(cells, cells + cellCount, results[i].cell) - cells);
+			base += results[i].coefficient * m_memory[results[i].cell];
+			step = results[i].coefficient * deltas[cell];
+		}
+		iterations = min(iterations, FirstIterationAbove(base, step, numeric_limits<Word>::max()));
+		iterations = min(iterations, FirstIterationBelow(base, step, numeric_limits<Word>::min()));
+		if (stored[i])
+		{
+			iterations = min(iterations, FirstIterationAbove(base, step, MAX_WORD));
+		}
+	}
+	switch (m_decoded[a_branch].opCode)
+	{
+	case OP_BM:
+		iterations = min(iterations, FirstIterationAbove(base, step, -1));
+		break;
+	case OP_BZ:
+		iterations = min(iterations, (base != 0) ? 0 : (step != 0) ? 1 : NEVER);
+		break;
+	case OP_BP:
+		iterations = min(iterations, FirstIterationBelow(base, step, 1));
+		break;
+	}
+
+	// A loop that never changes anything never ends, and there is nothing to skip.
+	if (iterations == 0 || iterations == NEVER)
+	{
+		return false;
+	}
+	for (int cell = 0; cell < cellCount; cell++)
+	{
+		WriteMemory(cells[cell], (Word)(m_memory[cells[cell]] + iterations * deltas[cell]));
+	}
+	a_accumulator = (Word)(base + (iterations - 1) * step);
+	return true;
+}
+
+// Runs a verified program with no checks. The words it can write are known ahead of time, so they
+// are marked dirty up front, and decoded afterwards so that the decoded memory matches memory
+// again for anything that looks at it later.
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::RunVerified()
+{
+	for (size_t i = 0; i < m_writtenWords.size(); i++)
+	{
+		MarkDirty(m_writtenWords[i]);
+	}
+	bool result = RunThreaded<false>();
+	for (size_t i = 0; i < m_writtenWords.size(); i++)
+	{
+		DecodeWord(m_writtenWords[i]);
+	}
+	return result;
+}
+
+/*
+Emulator::RunJit()
+
+NAME
+
+Emulator::RunJit - runs the program in memory with hot blocks translated into native code
+
+SYNOPSIS
+
+bool Emulator::RunJit();
+
+DESCRIPTION
+
+This function runs the program one word at a time, just like RunSwitched, until a location
+has been visited often enough for the JitCompiler to translate the block that starts there.
+From then on, that block runs as native code. A block hands control back at branches, HALT,
+READ and WRITE, and at any STORE whose value is too big to store; the instruction it
+stopped at is then performed here, so input, output and errors behave exactly
+as they do in the other engines. On machines the JitCompiler cannot generate code for, and
+for any configuration other than the assembler's Emulator with int words, the threaded engine is
+used instead.
+
+RETURNS
+
+Returns true if the program ran successfully without any errors being encountered. Returns false
+if there was an error that caused the program to stop running.
+*/
+template <int MemorySize, class WordType>
+bool BasicEmulator<MemorySize, WordType>::RunJit()
+{
+	// The native code is written for the emulator the assembler uses, with 32-bit words.
+	if constexpr (!is_same<BasicEmulator, Emulator>::value || !is_same<Word, int>::value)
+	{
+		return RunThreaded<true>();
+	}
+	else
+	{
+		if (!JitCompiler::IsAvailable())
+		{
+			return RunThreaded<true>();
+		}
+		if (m_jit == NULL)
+		{
+			m_jit = new JitCompiler(*this, m_memory.data(), m_decoded.data());
+		}
+
+		for (;;)
+		{
+			m_currentAddress = m_nextInstruction[m_currentAddress];
+			if (m_currentAddress == MEMSZ)
+			{
+				break;
+			}
+
+			int nextAddress;
+			JitCompiler::ExitReason reason = m_jit->RunBlock(m_currentAddress, m_accumulator, nextAddress);
+
+			if (reason == JitCompiler::EXIT_HALT)
+			{
+				m_currentAddress = MEMSZ;
+				return true;
+			}
+			if (reason == JitCompiler::EXIT_CONTINUE)
+			{
+				m_currentAddress = nextAddress;
+				continue;
+			}
+			if (reason == JitCompiler::EXIT_INTERPRET)
+			{
+				m_currentAddress = nextAddress;
+			}
+
+			// Perform the word at the current address the same way RunSwitched does.
+			const DecodedWord &word = m_decoded[m_currentAddress];
+			if (word.opCode != 0)
+			{
+				if (!PerformAction(word.opCode, word.address))
+				{
+					return false;
+				}
+			}
+			m_currentAddress++;
+		}
+
+		return true;
+	}
+}
+
+// Reads a value for READ from the I/O device, or from the log being replayed.
+template <int MemorySize, class WordType>
+typename BasicEmulator<MemorySize, WordType>::Word BasicEmulator<MemorySize, WordType>::ReadInput()
+{
+	if (m_log != NULL && m_log->IsActive())
+	{
+		return (Word)m_log->Read(*m_io, m_currentAddress, m_accumulator);
+	}
+	return (Word)m_io->Read();
+}
+
+// Sends the value of a WRITE to the I/O device, and notes it in the log, if any.
+template <int MemorySize, class WordType>
+void BasicEmulator<MemorySize, WordType>::WriteOutput(Word a_value)
+{
+	m_io->Write(a_value);
+	if (m_log != NULL)
+	{
+		m_log->Wrote(a_value);
+	}
+}
+
+// The emulator the assembler uses is the only configuration that is compiled.
+template class BasicEmulator<VC_MEMSZ, VC_WORD>;
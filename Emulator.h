@@ -4,34 +4,321 @@
 #ifndef _EMULATOR_H      // UNIX way of preventing multiple inclusions.
 #define _EMULATOR_H
 
-class Emulator {
+#include <string>
+#include <vector>
+#include <limits>
+#include <type_traits>
+#include "IODevice.h"
+#include "Profiler.h"
+
+// The configuration the assembler uses. The standard VC3600 has 10000 words of memory held in ints.
+#ifndef VC_MEMSZ
+#define VC_MEMSZ 10000
+#endif
+#ifndef VC_WORD
+#define VC_WORD int
+#endif
+
+class JitCompiler;
+class ExecutionLog;
+
+template <int MemorySize, class WordType>
+class BasicEmulator {
+
+	friend class JitCompiler;
 
 public:
 
-	const static int MEMSZ = 10000;	// The size of the memory of the VC3600.
+	typedef WordType Word;	// The type each word of memory is held in.
+
+	static constexpr int MEMSZ = MemorySize;	// The size of the memory of the VC3600.
+
+	// Instructions are stored as op code * ADDRESS_RADIX + address. The radix is the smallest
+	// power of ten that every address is below, which is 10000 for the standard VC3600.
+	static constexpr long long AddressRadix(long long a_radix = 10)
+	{
+		return (a_radix >= MemorySize) ? a_radix : AddressRadix(a_radix * 10);
+	}
+	static constexpr Word ADDRESS_RADIX = (Word)AddressRadix();
+
+	// The largest value a word may hold: two digits of op code and the address digits,
+	// or less if the word type cannot hold that many.
+	static constexpr Word MAX_WORD = (100 * AddressRadix() - 1 < (long long)numeric_limits<Word>::max()) ?
+		(Word)(100 * AddressRadix() - 1) : numeric_limits<Word>::max();
+
+	static_assert(13 * AddressRadix() + MemorySize - 1 <= (long long)numeric_limits<Word>::max(),
+		"The word type cannot hold a HALT instruction with the largest address.");
+
+	// The numeric op codes of the VC3600. OP_END only marks the word past the end of memory.
+	enum OpCode {
+		OP_DATA, OP_ADD, OP_SUB, OP_MULT, OP_DIV, OP_LOAD, OP_STORE,
+		OP_READ, OP_WRITE, OP_B, OP_BM, OP_BZ, OP_BP, OP_HALT, OP_END
+	};
+
+	// The errors a program can stop with while it runs. Every engine reports them in these words.
+	static constexpr const char *DIVIDE_BY_ZERO_ERROR = "ERROR: Division by zero!";
+	static constexpr const char *STORE_TOO_BIG_ERROR = "ERROR: Accumulator's value is too big to store in memory!";
+
+	// The ways the emulator can execute a program. They all produce the same results.
+	enum Engine {
+		ENGINE_SWITCH,		// Steps through PerformAction one word at a time.
+		ENGINE_THREADED,	// Jumps straight from one instruction's handler to the next.
+		ENGINE_JIT,			// Translates hot blocks into native code.
+		ENGINE_AUTO			// Threaded with no checks if the program passes VerifyImage, else switch.
+	};
+
+	// Sequences of instructions that the threaded engine can run as one operation.
+	enum FusedOp {
+		FUSED_LOAD_ADD_STORE = OP_END + 1, FUSED_LOAD_SUB_STORE, FUSED_LOAD_MULT_STORE,
+		FUSED_LOAD_SUB_BM, FUSED_LOAD_SUB_BZ, FUSED_LOAD_SUB_BP, FUSED_END
+	};
+
+	// A word of memory split into its op code and address. Words that are not
+	// instructions have an op code of 0.
+	struct DecodedWord {
+		int opCode = 0;
+		int address = 0;
+		int dispatch = 0;	// The op code, or the fused sequence that starts at this word.
+	};
 	
-	// Allocates 10000 words into the emulator's memory.
-	Emulator()
+	// Allocates MEMSZ words into the emulator's memory.
+	BasicEmulator() : m_memory(MEMSZ, 0), m_decoded(MEMSZ + 1), m_nextInstruction(MEMSZ + 1, MEMSZ),
+		m_dirty(MEMSZ, 0), m_rejectedLoops(MEMSZ, 0)
 	{
-		memset(m_memory, 0, MEMSZ * sizeof(int));
+		m_decoded[MEMSZ].opCode = OP_END;
+		m_decoded[MEMSZ].dispatch = OP_END;
+		m_engine = ENGINE_AUTO;
+		m_jit = NULL;
+		m_io = &m_console;
+		m_log = NULL;
+		m_verifyPending = true;
+		m_verified = false;
+		m_profiling = false;
+		m_tracing = false;
+		m_boundsChecking = false;
+		m_stepLimit = 0;
+		m_fusedOps = 0;
+		m_fastForward = false;
+		m_runNumber = 0;
 	}
+
+	// Releases the translated code, if any.
+	~BasicEmulator();
 	// Records instructions and data into VC-3600 memory.
-	bool InsertMemory(int a_location, int a_contents);
+	bool InsertMemory(int a_location, Word a_contents);
+
+	// Gets the contents of a word of memory.
+	Word GetMemory(int a_location) const { return m_memory[a_location]; }
+
+	// Splits a word into its op code and address. The op code is 0 if the word is data, which
+	// includes any word whose address would be outside of memory.
+	static void SplitWord(Word a_contents, int &a_opCode, int &a_address);
+
+	// Works out what ADD, SUB, MULT, DIV or LOAD leaves in the accumulator. Results that do not fit
+	// wrap around at the size of the word type, including the smallest word divided by -1, and DIV
+	// is only given an operand that CanDivide passes.
+	static Word Calculate(int a_opCode, Word a_accumulator, Word a_operand)
+	{
+		typedef make_unsigned_t<decltype(a_accumulator + a_operand)> Bits;
+		switch (a_opCode)
+		{
+		case OP_ADD:
+			return (Word)((Bits)a_accumulator + (Bits)a_operand);
+		case OP_SUB:
+			return (Word)((Bits)a_accumulator - (Bits)a_operand);
+		case OP_MULT:
+			return (Word)((Bits)a_accumulator * (Bits)a_operand);
+		case OP_DIV:
+			return (a_operand == -1) ? (Word)(0 - (Bits)a_accumulator) : (Word)(a_accumulator / a_operand);
+		default:
+			return a_operand;
+		}
+	}
+
+	// Determines if DIV can divide by a_operand. If not, the program stops with DIVIDE_BY_ZERO_ERROR.
+	static bool CanDivide(Word a_operand) { return a_operand != 0; }
+
+	// Determines if STORE can store a_accumulator. If not, the program stops with STORE_TOO_BIG_ERROR.
+	static bool CanStore(Word a_accumulator) { return a_accumulator <= MAX_WORD; }
+
+	// Determines if a branch instruction goes to its address with the accumulator holding a_accumulator.
+	static bool BranchTaken(int a_opCode, Word a_accumulator)
+	{
+		return a_opCode == OP_B || (a_opCode == OP_BM && a_accumulator < 0) ||
+			(a_opCode == OP_BZ && a_accumulator == 0) || (a_opCode == OP_BP && a_accumulator > 0);
+	}
+
+	// Selects the engine that RunProgram uses.
+	void SetEngine(Engine a_engine) { m_engine = a_engine; }
 
 	// Runs the VC-3600 program recorded in memory.
 	bool RunProgram();
 
+	// Fills memory from a location onwards with the words in a file: raw words if the name
+	// ends in ".bin", otherwise integers in text.
+	bool MapIn(int a_location, const string &a_fileName);
+
+	// Writes a run of words to a file (in the same formats as MapIn) when the program ends.
+	bool MapOut(int a_location, int a_count, const string &a_fileName);
+
+	// Remembers the contents of memory, so that ResetToSnapshot can go back to them.
+	void TakeSnapshot();
+
+	// Puts back the words written since the snapshot was taken.
+	void ResetToSnapshot();
+
+	// Selects where READ and WRITE get and send values. NULL goes back to the console.
+	void SetIODevice(IODevice *a_device) { m_io = (a_device != NULL) ? a_device : &m_console; }
+
+	// Selects the log that runs are recorded into or replayed from. NULL turns logging off.
+	void SetExecutionLog(ExecutionLog *a_log) { m_log = a_log; }
+
+	// Checks the program in memory, and lets ENGINE_AUTO run it unchecked if it passes.
+	bool VerifyImage(vector<string> &a_problems);
+
+	// Turns on collecting a profile, starting from empty counts. Every run adds to the same
+	// counts until profiling is turned on again. Does nothing if VC_NO_PROFILER is defined.
+	void SetProfiling(bool a_profiling)
+	{
+		m_profiling = a_profiling && VC_PROFILER;
+		if (m_profiling)
+		{
+			m_profiler.Reset(MEMSZ);
+		}
+	}
+
+	// The counts collected while profiling, or loaded with LoadProfile.
+	const Profiler &GetProfiler() const { return m_profiler; }
+
+	// Turns on printing each instruction as it is executed.
+	void SetTracing(bool a_tracing) { m_tracing = a_tracing; }
+
+	// Turns on checking that every operand is inside memory.
+	void SetBoundsChecking(bool a_checking) { m_boundsChecking = a_checking; }
+
+	// Stops the program after a number of instructions. 0 means no limit.
+	void SetStepLimit(long long a_limit) { m_stepLimit = a_limit; }
+
+	// Writes the execution counts to a file.
+	bool SaveProfile(const string &a_fileName);
+
+	// Reads execution counts written by an earlier run.
+	bool LoadProfile(const string &a_fileName);
+
+	// Fuses common instruction sequences for the threaded engine.
+	void FuseInstructions();
+
+	// Turns on skipping whole runs of iterations of simple counting loops (see ForwardLoop).
+	// Only the uninstrumented switch engine and the threaded engine do this.
+	void SetFastForward(bool a_fastForward) { m_fastForward = a_fastForward; }
+
 private:
 
-	int m_memory[MEMSZ]; // The memory of the VC3600.
-	int m_accumulator; // The accumulator used for operations.
+	// A run of memory that is written to a file when the program ends.
+	struct MapWindow {
+		int location;
+		int count;
+		string fileName;
+	};
+
+	vector<Word> m_memory; // The memory of the VC3600.
+	vector<DecodedWord> m_decoded; // The memory, decoded once when it is written, and OP_END past the end.
+	vector<int> m_nextInstruction; // The first instruction at or after each location.
+	Word m_accumulator; // The accumulator used for operations.
 	int m_currentAddress; // The current address being visited in memory.
+	Engine m_engine; // The engine that runs the program.
+	JitCompiler *m_jit; // Translated code, once the JIT engine has run.
+	ConsoleDevice m_console; // Prompts for READ and prints each WRITE.
+	IODevice *m_io; // The device READ and WRITE use.
+	ExecutionLog *m_log; // The log runs are recorded into or replayed from, if any.
+	bool m_verifyPending; // == true if memory has been loaded since the program was verified.
+	bool m_verified; // == true if the program passed VerifyImage.
+	vector<int> m_writtenWords; // The words a verified program can write.
+	bool m_profiling; // == true if execution counts are being collected.
+	bool m_tracing; // == true if each instruction is printed as it is executed.
+	bool m_boundsChecking; // == true if operands are checked against the size of memory.
+	long long m_stepLimit; // The most instructions a run may execute, or 0 for no limit.
+	vector<Word> m_snapshot; // The contents of memory when TakeSnapshot was called.
+	vector<unsigned char> m_dirty; // == 1 if the word may have been written since the snapshot.
+	vector<int> m_dirtyWords; // The locations marked in m_dirty.
+	vector<MapWindow> m_mapOut; // The words written to files when the program ends.
+	Profiler m_profiler; // What the program did while profiling was turned on.
+	unsigned m_fusedOps; // The fused sequences in use, one bit for each FusedOp.
+	bool m_fastForward; // == true if simple loops are skipped ahead in closed form.
+	unsigned m_runNumber; // Counts the runs, starting from 1.
+	vector<unsigned> m_rejectedLoops; // The run in which the loop ending at each branch was found not to fit.
 	
 	// Initializes the emulator's accumulator and starting address.
 	void InitEmulator();
 
+	// Runs the program on the engine that the settings call for.
+	bool RunSelectedEngine();
+
+	// Runs the program one word at a time through PerformAction, with the instrumentation
+	// the policy compiles in.
+	template <class Policy> bool RunSwitched();
+
+	// Runs the program with threaded dispatch. The checks on writes and divisors are
+	// only left out for programs that have passed VerifyImage.
+	template <bool CHECKED> bool RunThreaded();
+
+	// Runs a verified program with threaded dispatch and no checks.
+	bool RunVerified();
+
+	// Runs the program with hot blocks translated into native code.
+	bool RunJit();
+
+	// Reads a value for READ from the I/O device, or from the log being replayed.
+	Word ReadInput();
+
+	// Sends the value of a WRITE to the I/O device, and notes it in the log, if any.
+	void WriteOutput(Word a_value);
+
+	// Decodes the word at a location into the decoded memory.
+	void DecodeWord(int a_location);
+
+	// Updates the next instruction table after a word has become an instruction or data.
+	void UpdateNextInstruction(int a_location);
+
+	// Decodes a run of words that was copied into memory all at once.
+	void DecodeWords(int a_location, int a_count);
+
+	// Writes the MapOut windows to their files.
+	bool SaveMapOut();
+
+	// Works out which fused sequence, if any, starts at a location.
+	void FuseWord(int a_location);
+
+	// Determines which fused sequence a run of three op codes matches.
+	static int MatchFusedOp(int a_first, int a_second, int a_third);
+
+	// Skips the iterations of the loop from a_target to a_branch that are sure to go around
+	// again without an error. Returns true if any were skipped.
+	bool ForwardLoop(int a_branch, int a_target, Word &a_accumulator);
+
+	// Notes that a word may have been written since the snapshot.
+	void MarkDirty(int a_location)
+	{
+		if (m_dirty[a_location] == 0)
+		{
+			m_dirty[a_location] = 1;
+			m_dirtyWords.push_back(a_location);
+		}
+	}
+
+	// Writes a word into memory while the program is running.
+	void WriteMemory(int a_location, Word a_contents)
+	{
+		m_memory[a_location] = a_contents;
+		MarkDirty(a_location);
+		DecodeWord(a_location);
+	}
+
 	// Performs the action at the address.
 	bool PerformAction(int a_opCode, int a_address);
 };
 
+// The emulator the assembler runs programs on.
+typedef BasicEmulator<VC_MEMSZ, VC_WORD> Emulator;
+
 #endif
\ No newline at end of file
@@ -25,4 +25,10 @@ void Errors::DisplayErrors()
 	{
 		cout << *it << endl;
 	}
+}
+
+// Gets all the collected error messages.
+const vector<string> &Errors::GetErrors()
+{
+	return m_ErrorMsgs;
 }
\ No newline at end of file
@@ -22,6 +22,9 @@ public:
 	// Displays the collected error message.
 	static void DisplayErrors();
 
+	// Gets the collected error messages.
+	static const vector<string> &GetErrors();
+
 private:
 
 	static vector<string> m_ErrorMsgs;	// Collection of error messages.
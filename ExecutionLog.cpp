@@ -0,0 +1,335 @@
+//
+//		Implementation of the ExecutionLog class.
+//
+#include "stdafx.h"
+#include "ExecutionLog.h"
+
+// The first bytes of every log.
+static const char s_logHeader[] = { 'V', 'C', 'L', 'G', 1 };
+
+// Bytes are written to the file once this many are held back.
+static const size_t FLUSH_SIZE = 64 * 1024;
+
+// Appends an unsigned value, seven bits to a byte, with the top bit set on every byte but the last.
+static void PutVarint(vector<unsigned char> &a_buffer, unsigned long long a_value)
+{
+	while (a_value >= 0x80)
+	{
+		a_buffer.push_back((unsigned char)(a_value | 0x80));
+		a_value >>= 7;
+	}
+	a_buffer.push_back((unsigned char)a_value);
+}
+
+// Appends a signed value, with the sign in the lowest bit so that small negative values stay short.
+static void PutSigned(vector<unsigned char> &a_buffer, long long a_value)
+{
+	PutVarint(a_buffer, ((unsigned long long)a_value << 1) ^ (unsigned long long)(a_value >> 63));
+}
+
+// Takes an unsigned value written by PutVarint. Returns false if the log ends first.
+static bool GetVarint(const string &a_log, size_t &a_pos, unsigned long long &a_value)
+{
+	a_value = 0;
+	for (int shift = 0; shift < 64 && a_pos < a_log.size(); shift += 7)
+	{
+		unsigned char byte = (unsigned char)a_log[a_pos++];
+		a_value |= (unsigned long long)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Takes a signed value written by PutSigned.
+static bool GetSigned(const string &a_log, size_t &a_pos, long long &a_value)
+{
+	unsigned long long value;
+	if (!GetVarint(a_log, a_pos, value))
+	{
+		return false;
+	}
+	a_value = (long long)(value >> 1) ^ -(long long)(value & 1);
+	return true;
+}
+
+// Opens the log and writes its header. Nothing else is written until the first checkpoint.
+bool ExecutionLog::StartRecording(const string &a_fileName, int a_ringSize)
+{
+	m_file.open(a_fileName.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!m_file)
+	{
+		return false;
+	}
+	m_mode = MODE_RECORD;
+	m_buffer.assign(s_logHeader, s_logHeader + sizeof(s_logHeader));
+	m_blockValues.clear();
+	m_lastValue = 0;
+	m_reads = 0;
+	m_writes = 0;
+	m_outputHash = FNV_OFFSET;
+
+	size_t ringSize = (a_ringSize > 0) ? 1 : 0;
+	while (ringSize != 0 && ringSize < (size_t)a_ringSize)
+	{
+		ringSize *= 2;
+	}
+	m_ring.assign(ringSize, 0);
+	m_ringMask = (ringSize == 0) ? 0 : ringSize - 1;
+	m_ringNext = 0;
+	return true;
+}
+
+/*
+ExecutionLog::StartReplay()
+
+NAME
+
+ExecutionLog::StartReplay - reads a recorded log so that its run can be replayed
+
+SYNOPSIS
+
+bool ExecutionLog::StartReplay(const string &a_fileName);
+	a_fileName -> the log written by an earlier recording
+
+DESCRIPTION
+
+This function decodes the whole log up front: every value READ got, the state at each
+checkpoint, the state at the end of the run, and the addresses of the last instructions if
+they were kept. While the run is replayed, READ takes the values in order without touching its
+device, and each checkpoint is compared with the replayed run as it is reached.
+
+RETURNS
+
+Returns true if the log was read. Returns false if it could not be read, or is not a complete log.
+*/
+bool ExecutionLog::StartReplay(const string &a_fileName)
+{
+	string log;
+	if (!ReadWholeFile(a_fileName, log) || log.compare(0, sizeof(s_logHeader), s_logHeader, sizeof(s_logHeader)) != 0)
+	{
+		return false;
+	}
+
+	m_values.clear();
+	m_checkpoints.clear();
+	m_lastAddresses.clear();
+	size_t pos = sizeof(s_logHeader);
+	long long value = 0;
+	for (;;)
+	{
+		unsigned long long kind, count, field;
+		if (!GetVarint(log, pos, kind) || !GetVarint(log, pos, count))
+		{
+			return false;
+		}
+		for (unsigned long long i = 0; i < count; i++)
+		{
+			long long delta;
+			if (!GetSigned(log, pos, delta))
+			{
+				return false;
+			}
+			value += delta;
+			m_values.push_back(value);
+		}
+
+		State state;
+		state.reads = (long long)m_values.size();
+		if (!GetVarint(log, pos, field))
+		{
+			return false;
+		}
+		state.address = (int)field;
+		if (!GetSigned(log, pos, state.accumulator) || !GetVarint(log, pos, field))
+		{
+			return false;
+		}
+		state.writes = (long long)field;
+		if (!GetVarint(log, pos, state.outputHash))
+		{
+			return false;
+		}
+		if (kind == BLOCK_CHECKPOINT)
+		{
+			m_checkpoints.push_back(state);
+			continue;
+		}
+
+		// The end of the run, then the addresses of its last instructions.
+		if (!GetVarint(log, pos, field))
+		{
+			return false;
+		}
+		state.result = (int)field;
+		m_end = state;
+		long long address = 0;
+		if (!GetVarint(log, pos, count))
+		{
+			return false;
+		}
+		for (unsigned long long i = 0; i < count; i++)
+		{
+			long long delta;
+			if (!GetSigned(log, pos, delta))
+			{
+				return false;
+			}
+			address += delta;
+			m_lastAddresses.push_back((int)address);
+		}
+		break;
+	}
+
+	m_mode = MODE_REPLAY;
+	m_nextValue = 0;
+	m_reads = 0;
+	m_writes = 0;
+	m_outputHash = FNV_OFFSET;
+	m_divergence.clear();
+	return true;
+}
+
+// Gets the value for a READ. When replaying, a run that reads more values than were recorded
+// gets 0, as it would from a device that has run out of input.
+long long ExecutionLog::Read(IODevice &a_io, int a_address, long long a_accumulator)
+{
+	long long value = 0;
+	if (m_mode == MODE_REPLAY)
+	{
+		if (m_nextValue < m_values.size())
+		{
+			value = m_values[m_nextValue++];
+		}
+		else if (m_divergence.empty())
+		{
+			m_divergence = "The replayed run read more values than the recorded one, at location " +
+				to_string(a_address) + ".";
+		}
+	}
+	else
+	{
+		value = a_io.Read();
+		m_blockValues.push_back(value);
+	}
+	m_reads++;
+
+	if (m_reads % CHECKPOINT_READS == 0)
+	{
+		State state = CurrentState(a_address, a_accumulator);
+		if (m_mode == MODE_RECORD)
+		{
+			WriteBlock(BLOCK_CHECKPOINT, state);
+		}
+		else if (m_reads / CHECKPOINT_READS <= (long long)m_checkpoints.size())
+		{
+			CheckState(m_checkpoints[m_reads / CHECKPOINT_READS - 1], state, "At READ number " + to_string(m_reads));
+		}
+	}
+	return value;
+}
+
+// Writes the final state and closes the log, or checks the replayed run against the recorded end.
+void ExecutionLog::EndRun(bool a_result, int a_address, long long a_accumulator)
+{
+	State state = CurrentState(a_address, a_accumulator);
+	state.result = a_result ? 1 : 0;
+	if (m_mode == MODE_RECORD)
+	{
+		WriteBlock(BLOCK_END, state);
+		m_file.write((const char *)m_buffer.data(), m_buffer.size());
+		m_file.close();
+		m_buffer.clear();
+	}
+	else if (m_mode == MODE_REPLAY)
+	{
+		if (m_divergence.empty() && m_reads < (long long)m_values.size())
+		{
+			m_divergence = "The replayed run read fewer values than the recorded one.";
+		}
+		CheckState(m_end, state, "At the end of the run");
+	}
+	m_mode = MODE_OFF;
+}
+
+// Writes the values read since the last block, each as the difference from the one before, and
+// then the state. The end of the run is followed by the addresses of the last instructions.
+void ExecutionLog::WriteBlock(BlockKind a_kind, const State &a_state)
+{
+	PutVarint(m_buffer, a_kind);
+	PutVarint(m_buffer, m_blockValues.size());
+	for (size_t i = 0; i < m_blockValues.size(); i++)
+	{
+		PutSigned(m_buffer, m_blockValues[i] - m_lastValue);
+		m_lastValue = m_blockValues[i];
+	}
+	m_blockValues.clear();
+
+	PutVarint(m_buffer, (unsigned long long)a_state.address);
+	PutSigned(m_buffer, a_state.accumulator);
+	PutVarint(m_buffer, (unsigned long long)a_state.writes);
+	PutVarint(m_buffer, a_state.outputHash);
+
+	if (a_kind == BLOCK_END)
+	{
+		PutVarint(m_buffer, (unsigned long long)a_state.result);
+		unsigned long long count = (m_ringNext < m_ring.size()) ? m_ringNext : m_ring.size();
+		PutVarint(m_buffer, count);
+		long long address = 0;
+		for (unsigned long long i = m_ringNext - count; i < m_ringNext; i++)
+		{
+			PutSigned(m_buffer, m_ring[i & m_ringMask] - address);
+			address = m_ring[i & m_ringMask];
+		}
+	}
+
+	if (m_buffer.size() >= FLUSH_SIZE)
+	{
+		m_file.write((const char *)m_buffer.data(), m_buffer.size());
+		m_buffer.clear();
+	}
+}
+
+// Compares two states. Only the first difference in a replay is kept.
+void ExecutionLog::CheckState(const State &a_recorded, const State &a_replayed, const string &a_where)
+{
+	if (!m_divergence.empty())
+	{
+		return;
+	}
+
+	auto describe = [](const State &a_state)
+	{
+		return "location " + to_string(a_state.address) + " with accumulator " + to_string(a_state.accumulator) +
+			" after " + to_string(a_state.writes) + " WRITEs";
+	};
+	if (a_recorded.address != a_replayed.address || a_recorded.accumulator != a_replayed.accumulator ||
+		a_recorded.writes != a_replayed.writes)
+	{
+		m_divergence = a_where + ", the recorded run was at " + describe(a_recorded) +
+			", but the replayed run was at " + describe(a_replayed) + ".";
+	}
+	else if (a_recorded.outputHash != a_replayed.outputHash)
+	{
+		m_divergence = a_where + ", the replayed run had written different values from the recorded run.";
+	}
+	else if (a_recorded.result != a_replayed.result)
+	{
+		m_divergence = a_where + ", the recorded run " + (a_recorded.result ? "succeeded" : "stopped with an error") +
+			", but the replayed run " + (a_replayed.result ? "succeeded" : "stopped with an error") + ".";
+	}
+}
+
+// Gets the state of the run as it is now.
+ExecutionLog::State ExecutionLog::CurrentState(int a_address, long long a_accumulator) const
+{
+	State state;
+	state.reads = m_reads;
+	state.address = a_address;
+	state.accumulator = a_accumulator;
+	state.writes = m_writes;
+	state.outputHash = m_outputHash;
+	return state;
+}
@@ -0,0 +1,104 @@
+//
+//		ExecutionLog class - records the input of a run so that the run can be replayed exactly.
+//
+#ifndef _EXECUTIONLOG_H
+#define _EXECUTIONLOG_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "IODevice.h"
+using namespace std;
+
+class ExecutionLog {
+
+public:
+
+	// A checkpoint is taken after every CHECKPOINT_READS values that READ gets.
+	static const int CHECKPOINT_READS = 256;
+
+	// Starts a log in a file, keeping the addresses of the last a_ringSize instructions (rounded
+	// up to a power of two) if a_ringSize is not 0. Returns false if the file cannot be written.
+	bool StartRecording(const string &a_fileName, int a_ringSize);
+
+	// Reads a log to replay. Returns false if it cannot be read or is not a log.
+	bool StartReplay(const string &a_fileName);
+
+	// Determines if a run is being recorded or replayed.
+	bool IsActive() const { return m_mode != MODE_OFF; }
+
+	// Determines if the addresses of the last instructions are to be kept.
+	bool KeepsAddresses() const { return m_mode == MODE_RECORD && !m_ring.empty(); }
+
+	// Keeps the address of an instruction about to be executed.
+	void AddAddress(int a_address) { m_ring[m_ringNext++ & m_ringMask] = a_address; }
+
+	// Gets the value for a READ at an address: from the device when recording, and from the log,
+	// without touching the device, when replaying.
+	long long Read(IODevice &a_io, int a_address, long long a_accumulator);
+
+	// Notes the value of a WRITE, so that the output can be checked when replaying.
+	void Wrote(long long a_value)
+	{
+		m_writes++;
+		m_outputHash = (m_outputHash ^ (unsigned long long)a_value) * FNV_PRIME;
+	}
+
+	// Ends the run. Writes the final state when recording, and checks it when replaying.
+	void EndRun(bool a_result, int a_address, long long a_accumulator);
+
+	// Describes where the replayed run first differed from the recorded one, or is empty.
+	const string &GetDivergence() const { return m_divergence; }
+
+	// The addresses of the last instructions of the recorded run, oldest first.
+	const vector<int> &GetLastAddresses() const { return m_lastAddresses; }
+
+private:
+
+	enum Mode { MODE_OFF, MODE_RECORD, MODE_REPLAY };
+
+	// Blocks are either a checkpoint, or the end of the run.
+	enum BlockKind { BLOCK_CHECKPOINT, BLOCK_END };
+
+	// The state of a run at a checkpoint, or at its end.
+	struct State {
+		long long reads = 0;
+		int address = 0;
+		long long accumulator = 0;
+		long long writes = 0;
+		unsigned long long outputHash = 0;
+		int result = 0;		// 1 if the run succeeded, only set at the end.
+	};
+
+	static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+	static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+	Mode m_mode = MODE_OFF;				// Whether a run is being recorded or replayed.
+	ofstream m_file;					// The log being recorded.
+	vector<unsigned char> m_buffer;		// Encoded bytes that have not been written to the file yet.
+	vector<long long> m_blockValues;	// The values read since the last checkpoint.
+	long long m_lastValue = 0;			// The value read before, which the next one is encoded against.
+	vector<long long> m_values;			// Every value read in the recorded run, when replaying.
+	vector<State> m_checkpoints;		// The recorded checkpoints, when replaying.
+	State m_end;						// The recorded end of the run, when replaying.
+	size_t m_nextValue = 0;				// The next value to replay.
+	long long m_reads = 0;				// The values READ has got in this run.
+	long long m_writes = 0;				// The values WRITE has sent in this run.
+	unsigned long long m_outputHash = FNV_OFFSET;	// A hash of the values sent.
+	vector<int> m_ring;					// The addresses of the last instructions, when recording.
+	size_t m_ringMask = 0;				// The size of m_ring less one.
+	unsigned long long m_ringNext = 0;	// The addresses kept so far. The next goes at this, masked.
+	vector<int> m_lastAddresses;		// The recorded run's last addresses, when replaying.
+	string m_divergence;				// The first difference found when replaying.
+
+	// Writes a block of values and the state of the run into the log.
+	void WriteBlock(BlockKind a_kind, const State &a_state);
+
+	// Compares the replayed run with the recorded state, noting the first difference.
+	void CheckState(const State &a_recorded, const State &a_replayed, const string &a_where);
+
+	// Gets the state of the run as it is now.
+	State CurrentState(int a_address, long long a_accumulator) const;
+};
+
+#endif
@@ -3,6 +3,14 @@
 //
 #include "stdafx.h"
 #include "FileAccess.h"
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /*
 FileAccess::FileAccess()
@@ -19,51 +27,101 @@ void FileAccess::FileAccess(int argc, char *argv[]);
 
 DESCRIPTION
 
-This function accesses the file that is being passed into the program through the
-command line argument. It receives this information through the arguments that the
-main function receives when the assembler is started up. This allows the program to
-parse through each line and "assemble" the program.
+This function opens the file that is being passed into the program through the last command line
+argument. Any arguments before it are options for the assembler. It receives this information
+through the arguments that the main function receives when the assembler is started up. The whole
+file is mapped into memory once, and a single scan records where each line starts, so that both
+passes of the assembler go through the same lines without reading or copying the file again.
 */
 FileAccess::FileAccess(int argc, char *argv[])
 {
-	// Check that there is exactly one run time parameter.
-	if (argc != 2) {
-		cerr << "Usage: Assem <FileName>" << endl;
+	// Check that there is at least one run time parameter.
+	if (argc < 2) {
+		cerr << "Usage: Assem [options] <FileName>" << endl;
+		cerr << "       Assem --bench [results.json]" << endl;
 		exit(1);
 	}
-	// Open the file.  One might question if this is the best place to open the file.
-	// One might also question whether we need a file access class.
-	m_sfile.open(argv[1], ios::in);
+
+	// Map the file. An empty file cannot be mapped, and is left with no text.
+	bool opened = false;
+#if defined(_WIN32)
+	m_file = CreateFileA(argv[argc - 1], GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size;
+	if (m_file != INVALID_HANDLE_VALUE && GetFileSizeEx(m_file, &size))
+	{
+		m_size = (size_t)size.QuadPart;
+		if (m_size > 0)
+		{
+			m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+			m_text = (m_mapping != NULL) ? (const char *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		}
+		opened = (m_size == 0 || m_text != NULL);
+	}
+#else
+	int file = open(argv[argc - 1], O_RDONLY);
+	struct stat status;
+	if (file >= 0 && fstat(file, &status) == 0 && S_ISREG(status.st_mode))
+	{
+		m_size = (size_t)status.st_size;
+		if (m_size > 0)
+		{
+			void *text = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+			m_text = (text == MAP_FAILED) ? NULL : (const char *)text;
+		}
+		opened = (m_size == 0 || m_text != NULL);
+	}
+	if (file >= 0)
+	{
+		close(file);	// The mapping stays valid without the descriptor.
+	}
+#endif
 
 	// If the open failed, report the error and terminate.
-	if (!m_sfile) {
+	if (!opened) {
 		cerr << "Source file could not be opened, assembler terminated."
 			<< endl;
 		exit(1);
 	}
+
+	// Index the lines. Like getline, a newline at the very end is followed by one more, empty, line.
+	// The index ends with a start one past the end of the file, so that line i always runs from
+	// m_lineStarts[i] up to the character before m_lineStarts[i + 1].
+	m_lineStarts.push_back(0);
+	for (const char *pos = m_text, *end = m_text + m_size; pos != end; pos++)
+	{
+		pos = (const char *)memchr(pos, '\n', end - pos);
+		if (pos == NULL)
+		{
+			break;
+		}
+		m_lineStarts.push_back(pos - m_text + 1);
+	}
+	m_lineStarts.push_back(m_size + 1);
 }
 
-// The destructor just closes the file.
+// The destructor unmaps the file.
 FileAccess::~FileAccess()
 {
-	m_sfile.close();
+#if defined(_WIN32)
+	if (m_text != NULL) UnmapViewOfFile(m_text);
+	if (m_mapping != NULL) CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+	if (m_text != NULL) munmap((void *)m_text, m_size);
+#endif
 }
 
-// Get the next line from the file.
-bool FileAccess::GetNextLine(string &a_buff)
+// Get the next line from the index.
+bool FileAccess::GetNextLine(string_view &a_line)
 {
-	if (m_sfile.eof()) return false;
+	if (m_nextLine + 1 >= m_lineStarts.size()) return false;
 
-	getline(m_sfile, a_buff);
+	size_t start = m_lineStarts[m_nextLine];
+	size_t end = m_lineStarts[m_nextLine + 1] - 1;
+	a_line = (start == end) ? string_view() : string_view(m_text + start, end - start);
+	m_nextLine++;
 
 	// Return indicating success.
 	return true;
 }
-
-// "Rewinds" back to the beginning of the file.
-void FileAccess::Rewind()
-{
-	// Clean the end of file flag and go back to the beginning of the file.
-	m_sfile.clear();
-	m_sfile.seekg(0, ios::beg);
-}
\ No newline at end of file
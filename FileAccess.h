@@ -4,28 +4,36 @@
 #ifndef _FILEACCESS_H  // This is the way that multiple inclusions are defended against often used in UNIX
 #define _FILEACCESS_H // We use pragmas in Visual Studio.  See other include files
 
-#include <fstream>
 #include <stdlib.h>
 #include <string>
+#include <string_view>
+#include <vector>
 
 class FileAccess {
 
 public:
 
-	// Opens the file.
+	// Maps the file into memory and finds where each line starts.
 	FileAccess(int argc, char *argv[]);
 
-	// Closes the file.
+	// Unmaps the file.
 	~FileAccess();
 
-	// Get the next line from the source file.
-	bool GetNextLine(string &a_buff);
+	// Get the next line from the source file. The line stays valid as long as the FileAccess does.
+	bool GetNextLine(string_view &a_line);
 
-	// Put the file pointer back to the beginning of the file.
-	void Rewind();
+	// Go back to the first line of the file.
+	void Rewind() { m_nextLine = 0; }
 
 private:
 
-	ifstream m_sfile;		// Source file object.
+	const char *m_text = NULL;	// The contents of the file, or NULL if it is empty.
+	size_t m_size = 0;			// The size of the file.
+	vector<size_t> m_lineStarts;	// Where each line starts, and one past the end of the file.
+	size_t m_nextLine = 0;		// The line GetNextLine returns next.
+#if defined(_WIN32)
+	HANDLE m_file = INVALID_HANDLE_VALUE;	// The source file.
+	HANDLE m_mapping = NULL;	// The mapping of it.
+#endif
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,290 @@
+//
+//		Implementation of the Fuzzer class.
+//
+#include "stdafx.h"
+#include "Fuzzer.h"
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <thread>
+
+// Feeds the values of one input to READ, and throws the output away.
+class FuzzDevice : public IODevice {
+
+public:
+
+	// Starts feeding an input from its first value.
+	void SetInput(const vector<long long> *a_input)
+	{
+		m_input = a_input;
+		m_reads = 0;
+	}
+
+	// The number of READs so far, including any after the values ran out.
+	size_t GetReads() const { return m_reads; }
+
+	long long Read()
+	{
+		size_t next = m_reads++;
+		return (next < m_input->size()) ? (*m_input)[next] : 0;
+	}
+	void Write(long long) {}
+
+private:
+
+	const vector<long long> *m_input = NULL;	// The values being fed.
+	size_t m_reads = 0;							// The READs so far.
+};
+
+// Values that tend to find the edges of a program's arithmetic.
+static const long long s_interesting[] = {
+	0, 1, -1, 2, -2, 10, 100, 1000, 46341, -46341,
+	Emulator::MAX_WORD, -Emulator::MAX_WORD, Emulator::MAX_WORD / 2, Emulator::ADDRESS_RADIX, Emulator::ADDRESS_RADIX - 1
+};
+
+// Puts a branch count into one of eight buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127 and 128 up, so
+// that running a loop a few more times does not count as new coverage, but a new order of
+// magnitude does.
+static unsigned char Bucket(unsigned char a_count)
+{
+	if (a_count <= 3)
+	{
+		return (unsigned char)(1 << (a_count - 1));
+	}
+	if (a_count < 8)
+	{
+		return 1 << 3;
+	}
+	if (a_count < 16)
+	{
+		return 1 << 4;
+	}
+	if (a_count < 32)
+	{
+		return 1 << 5;
+	}
+	return (a_count < 128) ? (1 << 6) : (1 << 7);
+}
+
+// Starts with no coverage, no corpus and no findings.
+Fuzzer::Fuzzer(shared_ptr<const SharedImage> a_image, long long a_fuel)
+	: m_image(a_image), m_fuel(a_fuel), m_virgin(2 * Emulator::MEMSZ, 0), m_executions(0), m_stop(false)
+{
+}
+
+// Adds an input to the corpus, cut down to the longest input mutation makes.
+void Fuzzer::AddSeed(const vector<long long> &a_input)
+{
+	lock_guard<mutex> lock(m_lock);
+	m_corpus.push_back(vector<long long>(a_input.begin(), a_input.begin() + min(a_input.size(), MAX_INPUT_VALUES)));
+}
+
+/*
+Fuzzer::Run()
+
+NAME
+
+Fuzzer::Run - searches for inputs that make the program fail or never halt
+
+SYNOPSIS
+
+void Fuzzer::Run(int a_threads, double a_seconds);
+	a_threads -> the number of workers to run at once
+	a_seconds -> how long to search for
+
+DESCRIPTION
+
+This function starts the workers, each on a thread of its own, and stops them once the time is
+up. Every worker runs the program over and over on an ImageInstance of the shared image, so that
+going back to the loaded program between runs only puts back the few words the program writes.
+Each run's input is a mutation of one of the inputs in the corpus, which all the workers share.
+The branches each run takes and does not take are counted, and an input whose counts reach a
+bucket that no run has reached before is added to the corpus. A run that stops with an error,
+or is still going after the fuel it was given, is a finding. Only the first input found for each
+kind of finding at each location is kept.
+*/
+void Fuzzer::Run(int a_threads, double a_seconds)
+{
+	if (m_corpus.empty())
+	{
+		AddSeed(vector<long long>());
+	}
+	m_stop = false;
+
+	vector<thread> workers;
+	for (int worker = 0; worker < a_threads; worker++)
+	{
+		workers.push_back(thread(&Fuzzer::Worker, this, worker));
+	}
+	this_thread::sleep_for(chrono::duration<double>(a_seconds));
+	m_stop = true;
+	for (size_t worker = 0; worker < workers.size(); worker++)
+	{
+		workers[worker].join();
+	}
+}
+
+// Gets the findings, in order of kind and location.
+vector<Fuzzer::Finding> Fuzzer::GetFindings() const
+{
+	lock_guard<mutex> lock(m_lock);
+	vector<Finding> findings;
+	for (map<pair<int, int>, Finding>::const_iterator it = m_findings.begin(); it != m_findings.end(); it++)
+	{
+		findings.push_back(it->second);
+	}
+	return findings;
+}
+
+// Runs mutated inputs until told to stop. The lock is only taken to pick a parent, every
+// RUNS_PER_PARENT runs, and when a run does something that this worker has not seen before.
+void Fuzzer::Worker(int a_worker)
+{
+	mt19937_64 random(0x9e3779b97f4a7c15ULL * (a_worker + 1));
+	ImageInstance instance(m_image);
+	FuzzDevice device;
+	BranchCoverage coverage;
+	vector<unsigned char> seen(2 * Emulator::MEMSZ, 0);
+	set<pair<int, int>> found;
+	vector<long long> parent, other, input;
+	long long runs = 0;
+
+	while (!m_stop.load(memory_order_relaxed))
+	{
+		if (runs % RUNS_PER_PARENT == 0)
+		{
+			lock_guard<mutex> lock(m_lock);
+			parent = m_corpus[random() % m_corpus.size()];
+			other = m_corpus[random() % m_corpus.size()];
+		}
+		input = parent;
+		Mutate(input, other, random);
+
+		instance.Reset();
+		device.SetInput(&input);
+		ImageInstance::RunState state = instance.RunSlice(device, m_fuel, &coverage);
+		runs++;
+
+		// Values that were never read made no difference to the run.
+		input.resize(min(input.size(), device.GetReads()));
+
+		Finding finding;
+		bool failed = (state == ImageInstance::RUN_FAILED || state == ImageInstance::RUN_PREEMPTED);
+		if (failed)
+		{
+			finding.kind = (state == ImageInstance::RUN_FAILED) ? FIND_ERROR : FIND_HANG;
+			finding.address = instance.GetAddress();
+			finding.message = (state == ImageInstance::RUN_FAILED) ? instance.GetError() :
+				"The program did not halt within " + to_string(m_fuel) + " instructions.";
+			failed = found.insert(make_pair((int)finding.kind, finding.address)).second;
+		}
+		if (MergeCoverage(coverage, seen, NULL) || failed)
+		{
+			Report(input, coverage, failed ? &finding : NULL);
+		}
+		coverage.Clear();
+	}
+	m_executions += runs;
+}
+
+// Stacks one to four random changes onto the input.
+void Fuzzer::Mutate(vector<long long> &a_input, const vector<long long> &a_other, mt19937_64 &a_random) const
+{
+	const int interestingCount = sizeof(s_interesting) / sizeof(s_interesting[0]);
+	int changes = 1 + (int)(a_random() % 4);
+	for (int change = 0; change < changes; change++)
+	{
+		size_t size = a_input.size();
+		size_t pos = (size == 0) ? 0 : (size_t)(a_random() % size);
+		int choice = (int)(a_random() % 8);
+		if (size == 0 && choice < 5)
+		{
+			choice = 5;
+		}
+
+		switch (choice)
+		{
+		case 0:	// An interesting value.
+			a_input[pos] = s_interesting[a_random() % interestingCount];
+			break;
+		case 1:	// A small step up or down.
+			a_input[pos] += (long long)(a_random() % 33) - 16;
+			break;
+		case 2:	// Any value a word can hold.
+			a_input[pos] = (long long)(a_random() % (2 * (unsigned long long)Emulator::MAX_WORD + 1)) - Emulator::MAX_WORD;
+			break;
+		case 3:	// The other sign.
+			a_input[pos] = -a_input[pos];
+			break;
+		case 4:	// One value fewer.
+			a_input.erase(a_input.begin() + pos);
+			break;
+		case 5:	// One value more.
+			if (size < MAX_INPUT_VALUES)
+			{
+				long long value = (a_random() % 2 == 0) ? s_interesting[a_random() % interestingCount] :
+					(long long)(a_random() % 200) - 100;
+				a_input.insert(a_input.begin() + (size == 0 ? 0 : a_random() % (size + 1)), value);
+			}
+			break;
+		case 6:	// A run of values repeated.
+			if (size > 0 && size < MAX_INPUT_VALUES)
+			{
+				size_t length = 1 + a_random() % min(size - pos, MAX_INPUT_VALUES - size);
+				vector<long long> run(a_input.begin() + pos, a_input.begin() + pos + length);
+				a_input.insert(a_input.begin() + pos, run.begin(), run.end());
+			}
+			break;
+		case 7:	// The start of this input and the end of the other.
+			if (!a_other.empty())
+			{
+				size_t cut = (size_t)(a_random() % a_other.size());
+				a_input.resize(min(pos, MAX_INPUT_VALUES - (a_other.size() - cut)));
+				a_input.insert(a_input.end(), a_other.begin() + cut, a_other.end());
+			}
+			break;
+		}
+	}
+}
+
+// Merges the buckets a run reached into a map of the buckets seen. Counts each branch way that
+// is seen for the first time, if asked to.
+bool Fuzzer::MergeCoverage(const BranchCoverage &a_coverage, vector<unsigned char> &a_virgin, int *a_newEdges)
+{
+	bool isNew = false;
+	for (size_t i = 0; i < a_coverage.touched.size(); i++)
+	{
+		int edge = a_coverage.touched[i];
+		unsigned char bucket = Bucket(a_coverage.counts[edge]);
+		if ((a_virgin[edge] & bucket) == 0)
+		{
+			if (a_virgin[edge] == 0 && a_newEdges != NULL)
+			{
+				(*a_newEdges)++;
+			}
+			a_virgin[edge] |= bucket;
+			isNew = true;
+		}
+	}
+	return isNew;
+}
+
+// Adds the input to the corpus if no worker has reached its coverage before, and keeps the
+// finding if it is the first of its kind at its location.
+void Fuzzer::Report(const vector<long long> &a_input, const BranchCoverage &a_coverage, const Finding *a_finding)
+{
+	lock_guard<mutex> lock(m_lock);
+	if (MergeCoverage(a_coverage, m_virgin, &m_edgesCovered))
+	{
+		m_corpus.push_back(a_input);
+	}
+	if (a_finding != NULL)
+	{
+		pair<int, int> key((int)a_finding->kind, a_finding->address);
+		if (m_findings.find(key) == m_findings.end())
+		{
+			m_findings[key] = *a_finding;
+			m_findings[key].input = a_input;
+		}
+	}
+}
@@ -0,0 +1,80 @@
+//
+//		Fuzzer class - searches for inputs that make a VC3600 program fail or never halt.
+//
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+#include "SharedImage.h"
+
+class Fuzzer {
+
+public:
+
+	// The ways a run can go wrong.
+	enum FindingKind {
+		FIND_ERROR,		// The program stopped with an error, such as DIV by zero.
+		FIND_HANG		// The program did not halt within the fuel it was given.
+	};
+
+	// An input that made the program go wrong, and where.
+	struct Finding {
+		FindingKind kind;
+		int address;				// The instruction that failed, or where the program was when it ran out of fuel.
+		string message;				// The error, or a note that the program did not halt.
+		vector<long long> input;	// The values for READ that led to it.
+	};
+
+	// Prepares to fuzz a program, counting a run that takes more than a_fuel instructions as one
+	// that never halts.
+	Fuzzer(shared_ptr<const SharedImage> a_image, long long a_fuel);
+
+	// Adds an input to start from.
+	void AddSeed(const vector<long long> &a_input);
+
+	// Fuzzes with a number of threads for a number of seconds.
+	void Run(int a_threads, double a_seconds);
+
+	// Gets the findings, one for each kind and location, in order of kind and location.
+	vector<Finding> GetFindings() const;
+
+	// The runs made, the inputs kept for reaching new coverage, and the branch ways covered.
+	long long GetExecutions() const { return m_executions; }
+	size_t GetCorpusSize() const { return m_corpus.size(); }
+	int GetEdgesCovered() const { return m_edgesCovered; }
+
+private:
+
+	// The longest input that mutation makes.
+	static constexpr size_t MAX_INPUT_VALUES = 256;
+
+	// The runs a worker makes from one parent before it picks another.
+	static constexpr int RUNS_PER_PARENT = 64;
+
+	shared_ptr<const SharedImage> m_image;	// The program being fuzzed.
+	long long m_fuel;						// The most instructions a run may take.
+	mutable mutex m_lock;					// Guards the corpus, the coverage and the findings.
+	vector<vector<long long>> m_corpus;		// The inputs that reached new coverage.
+	vector<unsigned char> m_virgin;			// The count buckets seen so far, one bit each, for each branch way.
+	int m_edgesCovered = 0;					// The branch ways that have been seen at all.
+	map<pair<int, int>, Finding> m_findings;	// The first finding for each kind and location.
+	atomic<long long> m_executions;			// The runs made by every worker.
+	atomic<bool> m_stop;					// == true once the workers are to stop.
+
+	// Runs inputs on one thread until told to stop.
+	void Worker(int a_worker);
+
+	// Changes an input in a random way, sometimes splicing in part of another.
+	void Mutate(vector<long long> &a_input, const vector<long long> &a_other, mt19937_64 &a_random) const;
+
+	// Turns the branch counts of a run into one bit per bucket, and merges them into a map of
+	// buckets seen. Returns true if any bit was new.
+	static bool MergeCoverage(const BranchCoverage &a_coverage, vector<unsigned char> &a_virgin, int *a_newEdges);
+
+	// Keeps an input that reached new coverage, and notes what went wrong in the run, if anything.
+	void Report(const vector<long long> &a_input, const BranchCoverage &a_coverage, const Finding *a_finding);
+};
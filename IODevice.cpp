@@ -0,0 +1,200 @@
+//
+//		Implementation of the IODevice classes.
+//
+#include "stdafx.h"
+#include "IODevice.h"
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <climits>
+
+// Prompts the user and reads a value.
+long long ConsoleDevice::Read()
+{
+	long long input = 0;
+	cout << "? ";
+	cin >> setw(6) >> input;
+	return input;
+}
+
+// Prints a value on its own line.
+void ConsoleDevice::Write(long long a_value)
+{
+	cout << a_value << endl;
+}
+
+/*
+ParseIntegers()
+
+NAME
+
+ParseIntegers - parses the integers in a buffer
+
+SYNOPSIS
+
+void ParseIntegers(const char *a_text, size_t a_length, vector<long long> &a_values);
+	a_text -> the text holding the values
+	a_length -> the number of characters in the text
+	a_values -> the values found, added in order
+
+DESCRIPTION
+
+This function finds every integer in the text. Integers are separated by anything that is not a
+digit or a sign. The parsing is done by hand rather than with streams, since the text may hold
+millions of values. A number too big for a long long gives the largest (or, if negative, the
+smallest) long long, which is what extracting it from a stream stores, as ConsoleDevice does.
+*/
+void ParseIntegers(const char *a_text, size_t a_length, vector<long long> &a_values)
+{
+	const char *pos = a_text;
+	const char *end = a_text + a_length;
+	while (pos < end)
+	{
+		// Find the start of the next number.
+		bool negative = false;
+		if ((*pos == '-' || *pos == '+') && pos + 1 < end && isdigit((unsigned char)pos[1]))
+		{
+			negative = (*pos == '-');
+			pos++;
+		}
+		if (!isdigit((unsigned char)*pos))
+		{
+			pos++;
+			continue;
+		}
+
+		long long value = 0;
+		bool tooBig = false;
+		while (pos < end && isdigit((unsigned char)*pos))
+		{
+			int digit = *pos - '0';
+			if (value > (LLONG_MAX - digit) / 10)
+			{
+				tooBig = true;
+			}
+			else
+			{
+				value = value * 10 + digit;
+			}
+			pos++;
+		}
+		if (tooBig)
+		{
+			a_values.push_back(negative ? LLONG_MIN : LLONG_MAX);
+		}
+		else
+		{
+			a_values.push_back(negative ? -value : value);
+		}
+	}
+}
+
+// Reads all of a file, or of standard input if the name is "-".
+bool ReadWholeFile(const string &a_fileName, string &a_text)
+{
+	if (a_fileName == "-")
+	{
+		a_text.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+		return true;
+	}
+	ifstream file(a_fileName.c_str(), ios::in | ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	a_text.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	return true;
+}
+
+// Parses the values that READ will get, all at once so that a READ only has to take the next one.
+void BatchDevice::SetInput(const char *a_text, size_t a_length)
+{
+	m_values.clear();
+	m_nextValue = 0;
+	ParseIntegers(a_text, a_length, m_values);
+}
+
+// Reads a whole file and parses the integers in it.
+bool BatchDevice::LoadInput(const string &a_fileName)
+{
+	string text;
+	if (!ReadWholeFile(a_fileName, text))
+	{
+		return false;
+	}
+	SetInput(text.data(), text.size());
+	return true;
+}
+
+// Takes the next value that was parsed, or 0 if there are none left.
+long long BatchDevice::Read()
+{
+	if (m_nextValue == m_values.size())
+	{
+		return 0;
+	}
+	return m_values[m_nextValue++];
+}
+
+// Adds a value and a new line to the output buffer, sending the buffer first if it is full.
+void BatchDevice::Write(long long a_value)
+{
+	if (m_buffer.empty())
+	{
+		m_buffer.resize(BUFFER_SIZE);
+	}
+	if (m_used + 24 > BUFFER_SIZE)
+	{
+		Flush();
+	}
+
+	// Write the digits backwards into a scratch area, then copy them over in order.
+	char digits[24];
+	int count = 0;
+	unsigned long long value = (a_value < 0) ? 0 - (unsigned long long)a_value : (unsigned long long)a_value;
+	do
+	{
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+
+	if (a_value < 0)
+	{
+		m_buffer[m_used++] = '-';
+	}
+	while (count > 0)
+	{
+		m_buffer[m_used++] = digits[--count];
+	}
+	m_buffer[m_used++] = '\n';
+}
+
+// Sends the output buffer.
+void BatchDevice::Flush()
+{
+	if (m_used > 0)
+	{
+		m_out.write(&m_buffer[0], m_used);
+		m_used = 0;
+	}
+	m_out.flush();
+}
+
+// Takes the first value waiting, or 0 if there are none.
+long long QueueDevice::Read()
+{
+	if (m_input.empty())
+	{
+		return 0;
+	}
+	long long value = m_input.front();
+	m_input.pop_front();
+	return value;
+}
+
+// Keeps a value, on its own line, with the output.
+void QueueDevice::Write(long long a_value)
+{
+	m_output += to_string(a_value);
+	m_output += '\n';
+}
@@ -0,0 +1,113 @@
+//
+//		IODevice classes - where the READ and WRITE instructions of the VC3600 get and send their values.
+//
+#ifndef _IODEVICE_H
+#define _IODEVICE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+using namespace std;
+
+// Parses every integer in a buffer, in order. Anything that is not a digit or a sign separates them.
+void ParseIntegers(const char *a_text, size_t a_length, vector<long long> &a_values);
+
+// Reads a whole file, or standard input if the name is "-". Returns false if it cannot be read.
+bool ReadWholeFile(const string &a_fileName, string &a_text);
+
+class IODevice {
+
+public:
+
+	virtual ~IODevice() {}
+
+	// Gets the value for a READ. Returns 0 once the input has run out.
+	virtual long long Read() = 0;
+
+	// Sends the value of a WRITE.
+	virtual void Write(long long a_value) = 0;
+
+	// Sends any output that is being held back. Called when the program stops.
+	virtual void Flush() {}
+
+	// Determines if a READ can get its value without waiting for one to arrive.
+	virtual bool IsReadReady() { return true; }
+};
+
+// Prompts the user for every READ and prints every WRITE straight away.
+class ConsoleDevice : public IODevice {
+
+public:
+
+	long long Read();
+	void Write(long long a_value);
+};
+
+// Reads values that were parsed ahead of time from a file or buffer, and holds back output
+// until the program stops or the output buffer fills.
+class BatchDevice : public IODevice {
+
+public:
+
+	// Prepares to write the output to a stream.
+	BatchDevice(ostream &a_out = cout) : m_out(a_out), m_nextValue(0), m_used(0) {}
+
+	// Sends anything still held back.
+	~BatchDevice() { Flush(); }
+
+	// Parses the integers in a buffer to be the values for READ.
+	void SetInput(const char *a_text, size_t a_length);
+
+	// Parses the integers in a file, or in standard input if the name is "-".
+	bool LoadInput(const string &a_fileName);
+
+	// Gets the values for READ, in order.
+	const vector<long long> &GetInput() const { return m_values; }
+
+	long long Read();
+	void Write(long long a_value);
+	void Flush();
+
+private:
+
+	const static int BUFFER_SIZE = 1 << 16;	// Bytes of output held back at most.
+
+	ostream &m_out;				// Where the output goes.
+	vector<long long> m_values;	// The values for READ, in order.
+	size_t m_nextValue;			// The next value READ gets.
+	vector<char> m_buffer;		// Output that has not been sent yet, allocated on the first WRITE.
+	int m_used;					// Bytes of the buffer in use.
+};
+
+// Takes the values for READ as they arrive, and keeps the output until it is collected. A READ
+// with no value waiting is not ready, so the program can be set aside until one is pushed.
+class QueueDevice : public IODevice {
+
+public:
+
+	// Adds a value for READ.
+	void Push(long long a_value) { m_input.push_back(a_value); }
+
+	// Notes that no more values will arrive. From then on, READ gets 0 once the values run out.
+	void CloseInput() { m_closed = true; }
+
+	// Takes the output sent since it was last taken.
+	string TakeOutput()
+	{
+		string output;
+		output.swap(m_output);
+		return output;
+	}
+
+	long long Read();
+	void Write(long long a_value);
+	bool IsReadReady() { return !m_input.empty() || m_closed; }
+
+private:
+
+	deque<long long> m_input;	// The values waiting for READ.
+	bool m_closed = false;		// == true if no more values will arrive.
+	string m_output;			// The output that has not been taken yet.
+};
+#endif
@@ -0,0 +1,128 @@
+//
+//		Implementation of the ImageVerifier class.
+//
+#include "stdafx.h"
+#include "ImageVerifier.h"
+
+/*
+ImageVerifier::Verify()
+
+NAME
+
+ImageVerifier::Verify - checks that the loaded program can run without per-instruction checks
+
+SYNOPSIS
+
+bool ImageVerifier::Verify();
+
+DESCRIPTION
+
+This function works out which words the emulator could step onto, starting from location 0
+and following every branch, and treats those words as code. Every other word is data. A program
+passes if:
+
+	every word that could be stepped onto is either an instruction with a valid op code and an
+	operand inside memory, or a value that can only be data (below ADDRESS_RADIX);
+
+	no STORE or READ writes to a word that could be stepped onto, so what each word decodes to
+	can never change while the program runs;
+
+	no DIV divides by a word that starts out as zero or that a STORE or READ can write.
+
+A program that passes can be run without re-decoding the words it writes and without checking
+divisors. The reasons a program did not pass are kept for GetProblems.
+
+RETURNS
+
+Returns true if the program passed, false otherwise.
+*/
+bool ImageVerifier::Verify()
+{
+	m_walked.assign(Emulator::MEMSZ, false);
+	m_written.assign(Emulator::MEMSZ, false);
+	m_writtenWords.clear();
+	m_problems.clear();
+
+	// Walk every path through the program, starting where the emulator does.
+	vector<int> pending(1, 0);
+	while (!pending.empty())
+	{
+		int loc = pending.back();
+		pending.pop_back();
+		WalkFrom(loc, pending);
+	}
+
+	// Find the words the program can write. A write into a word the emulator steps onto could
+	// change what the program runs.
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(loc), opCode, address);
+		if (!m_walked[loc] || (opCode != Emulator::OP_STORE && opCode != Emulator::OP_READ))
+		{
+			continue;
+		}
+		if (!m_written[address])
+		{
+			m_written[address] = true;
+			m_writtenWords.push_back(address);
+		}
+		if (m_walked[address])
+		{
+			AddProblem(loc, "writes to location " + to_string(address) + ", which can be run as an instruction");
+		}
+	}
+
+	// A divisor is only known not to be zero if it starts out that way and is never written.
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(loc), opCode, address);
+		if (m_walked[loc] && opCode == Emulator::OP_DIV &&
+			(m_emul.GetMemory(address) == 0 || m_written[address]))
+		{
+			AddProblem(loc, "divides by location " + to_string(address) + ", which could be zero");
+		}
+	}
+
+	return m_problems.empty();
+}
+
+// Marks the words from a location onwards that the emulator steps onto, until it reaches a B or
+// HALT, the end of memory, or a word that has already been walked. Branch targets are added to
+// the pending locations.
+void ImageVerifier::WalkFrom(int a_location, vector<int> &a_pending)
+{
+	for (int loc = a_location; loc < Emulator::MEMSZ && !m_walked[loc]; loc++)
+	{
+		m_walked[loc] = true;
+
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(loc), opCode, address);
+		if (opCode == 0)
+		{
+			// SplitWord treats a valid op code with an address past the end of memory as data.
+			Emulator::Word contents = m_emul.GetMemory(loc);
+			if (contents >= Emulator::ADDRESS_RADIX)
+			{
+				Emulator::Word wordOpCode = contents / Emulator::ADDRESS_RADIX;
+				AddProblem(loc, (wordOpCode >= 1 && wordOpCode <= 13) ? "has an operand outside of memory" : "has an unknown op code");
+			}
+			continue;
+		}
+		if (opCode >= Emulator::OP_B && opCode <= Emulator::OP_BP)
+		{
+			a_pending.push_back(address);
+		}
+		if (opCode == Emulator::OP_B || opCode == Emulator::OP_HALT)
+		{
+			return;
+		}
+	}
+}
+
+// Records a problem with the word at a location.
+void ImageVerifier::AddProblem(int a_location, const string &a_problem)
+{
+	m_problems.push_back("Location " + to_string(a_location) + " " + a_problem + ".");
+}
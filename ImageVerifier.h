@@ -0,0 +1,41 @@
+//
+//		ImageVerifier class - checks a loaded VC3600 program before it is run.
+//
+#pragma once
+
+#include <vector>
+#include "Emulator.h"
+
+class ImageVerifier {
+
+public:
+
+	// Prepares to check the program in the emulator's memory.
+	ImageVerifier(const Emulator &a_emul) : m_emul(a_emul) {}
+
+	// Checks the program. Returns true if it can run without any checks.
+	bool Verify();
+
+	// Describes each reason the program did not pass.
+	const vector<string> &GetProblems() const { return m_problems; }
+
+	// The words that a STORE or READ in the program can write.
+	const vector<int> &GetWrittenWords() const { return m_writtenWords; }
+
+	// Determines if the emulator could step onto the word while the program is unchanged.
+	bool IsWalked(int a_location) const { return m_walked[a_location]; }
+
+private:
+
+	const Emulator &m_emul;		// The emulator holding the loaded program.
+	vector<bool> m_walked;		// == true if the emulator could step onto the word.
+	vector<bool> m_written;		// == true if a STORE or READ can write the word.
+	vector<int> m_writtenWords;	// The locations of the words in m_written.
+	vector<string> m_problems;	// Why the program did not pass.
+
+	// Marks the words the emulator could step onto, and checks each instruction it meets.
+	void WalkFrom(int a_location, vector<int> &a_pending);
+
+	// Records a reason the program did not pass.
+	void AddProblem(int a_location, const string &a_problem);
+};
@@ -3,6 +3,8 @@
 //
 #include "stdafx.h"
 #include "Instruction.h"
+#include <algorithm>
+#include <climits>
 
 /*
 Instruction::InstructionType Instruction::ParseInstruction()
@@ -14,8 +16,8 @@ passed into the function
 
 SYNOPSIS
 
-Instruction::InstructionType Instruction::ParseInstruction(string &a_buff);
-	a_buff -> current line being visited in the file passed into program
+Instruction::InstructionType Instruction::ParseInstruction(string_view a_line);
+	a_line -> current line being visited in the file passed into program
 
 DESCRIPTION
 
@@ -24,122 +26,78 @@ variables in the Instruction class will be filled in, made easier through the us
 functions to assist in the parsing. The function aims to fill in as many variables in the Instruction
 class as possible to make creating the Symbol Table and the translations easier.
 
+The line is split into words in a single pass, without copying it: the label, op code and
+operand all point into the line itself, and op codes are compared without regard to case
+instead of being lowercased first.
+
 RETURNS
 
 Returns the type of the instruction that is passed in.
 */
-Instruction::InstructionType Instruction::ParseInstruction(string &a_buff)
+Instruction::InstructionType Instruction::ParseInstruction(string_view a_line)
 {
 	// Initialize the member variables.
 	InitMemVariables();
 
-	m_instruction = a_buff;
-	string a, b, c, d;
+	m_instruction = a_line;
 
 	// If the first character is a semicolon, then the entire line is a comment and should
 	// be indicated as such.
-	if (IsComment(a_buff))
+	if (IsComment(a_line))
 	{
 		return Instruction::ST_Comment;
 	}
-	
-	// If there any comments after the first character, remove them.
-	DeleteComments(a_buff);
 
-	istringstream parser(a_buff);
-	parser >> a >> b >> c >> d;
+	// Anything after a semicolon is a comment, and is not split into words.
+	string_view words[4];
+	int count = SplitWords(a_line, words, 4);
 
-	// "d" should be empty. If it isn't, we're going to have an error later.
-	if (!d.empty())
+	// A fourth word means we're going to have an error later.
+	if (count == 4)
 	{
 		m_hasExtraOps = true;
 	}
 
-	// If "c" is empty, then there should be no label, and the op code should be in "a."
-	if (c.empty())
-	{
-		m_Label = "";
-		m_OpCode = a;
-		// Check to see if "b" is a numeric operand.
-		if (ConvertToInt(b))
-		{
-			m_IsNumericOperand = true;
-			m_OperandValue = stoi(b);
-		}
-		m_Operand = b;
+	// With fewer than three words there is no label, and the op code is the first word.
+	int first = (count < 3) ? 0 : 1;
+	m_Label = (first == 0) ? string_view() : words[0];
+	m_OpCode = words[first];
+	m_Operand = words[first + 1];
 
-		// Check to see if "a" is op code. Converting to lowercase makes comparison easier.
-		ConvertToLower(a);
-		if (IsEnd(a))
-		{
-			return InstructionType::ST_End;
-		}
-		if (IsMachineLanguage(a))
-		{
-			// Find the numeric op code for the machine language instruction.
-			m_NumOpCode = FindNumericOpCode(a);
-			m_type = ST_MachineLanguage;
+	// Check to see if the operand is numeric.
+	if (ConvertToInt(m_Operand, m_OperandValue))
+	{
+		m_IsNumericOperand = true;
+	}
 
-			return InstructionType::ST_MachineLanguage;
-		}
-		if (IsAssemblyLanguage(a))
-		{
-			return InstructionType::ST_AssemblerInstr;
-		}
-		if (!IsAssemblyLanguage(a) && !IsMachineLanguage(a))
-		{
-			return InstructionType::ST_NotInstr;
-		}
+	// Check to see what the op code is, in any case.
+	if (IsEnd(m_OpCode))
+	{
+		return InstructionType::ST_End;
 	}
-	// If "c" is not empty, then there should be a label.
-	else
+	if (IsMachineLanguage(m_OpCode))
 	{
-		m_Label = a;
-		m_OpCode = b;
-		// Check to see if "c" is a numeric operand.
-		if (ConvertToInt(c))
-		{
-			m_IsNumericOperand = true;
-			m_OperandValue = stoi(c);
-		}
-		m_Operand = c;
+		// Find the numeric op code for the machine language instruction.
+		m_NumOpCode = FindNumericOpCode(m_OpCode);
+		m_type = ST_MachineLanguage;
 
-		// Check to see if "b" really is op code. Converting to lowercase makes comparison easier.
-		ConvertToLower(b);
-		if (IsEnd(b))
-		{
-			return InstructionType::ST_End;
-		}
-		if (IsMachineLanguage(b))
-		{
-			// Find the numeric op code for the machine language instruction.
-			m_NumOpCode = FindNumericOpCode(b);
-			m_type = ST_MachineLanguage;
-
-			return InstructionType::ST_MachineLanguage;
-		}
-		if (IsAssemblyLanguage(b))
-		{
-			return InstructionType::ST_AssemblerInstr;
-		}
-		if (!IsMachineLanguage(b) && !IsMachineLanguage(b))
-		{
-			return InstructionType::ST_NotInstr;
-		}
+		return InstructionType::ST_MachineLanguage;
+	}
+	if (IsAssemblyLanguage(m_OpCode))
+	{
+		return InstructionType::ST_AssemblerInstr;
 	}
+	return InstructionType::ST_NotInstr;
 }
 
 // Computes the location of the next instruction.
 int Instruction::LocationNextInstruction(int a_loc)
 {
-	//Easier to compare and to keep original op code intact.
-	string opCodeCheck = m_OpCode;
-	ConvertToLower(opCodeCheck);
-	if (opCodeCheck == "org")
+	if (EqualsIgnoreCase(m_OpCode, "org"))
 	{
 		return m_OperandValue;
 	}
-	else if (opCodeCheck == "ds")
+	else if (EqualsIgnoreCase(m_OpCode, "ds"))
 	{
 		return a_loc + m_OperandValue;
 	}
@@ -149,13 +107,35 @@ int Instruction::LocationNextInstruction(int a_loc)
 	}
 }
 
+// Compares a character at a time, lowering only ASCII letters, so nothing depends on the locale.
+bool Instruction::EqualsIgnoreCase(string_view a_word, string_view a_lowercase)
+{
+	if (a_word.size() != a_lowercase.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < a_word.size(); i++)
+	{
+		char c = a_word[i];
+		if (c >= 'A' && c <= 'Z')
+		{
+			c = (char)(c - 'A' + 'a');
+		}
+		if (c != a_lowercase[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 // Initializes all the member variables.
 void Instruction::InitMemVariables()
 {
-	m_Label = "";
-	m_OpCode = "";
-	m_Operand = "";
-	m_instruction = "";
+	m_Label = string_view();
+	m_OpCode = string_view();
+	m_Operand = string_view();
+	m_instruction = string_view();
 	m_NumOpCode = 0;
 	m_type = ST_Comment;
 	m_IsNumericOperand = false;
@@ -164,101 +144,82 @@ void Instruction::InitMemVariables()
 }
 
 // Determines if the entire line is a comment.
-bool Instruction::IsComment(string a_parsedWord)
+bool Instruction::IsComment(string_view a_line)
 {
-	char firstChar = a_parsedWord[0];
-	if (firstChar == ';')
-	{
-		return true;
-	}
-	else
-	{
-		return false;
-	}
+	return !a_line.empty() && a_line[0] == ';';
 }
 
-// Deletes any portions of the string that has a semicolon and whatever follows.
-void Instruction::DeleteComments(string & a_instruction)
+// Splits the line into words separated by white space, stopping at the first semicolon. Words
+// past a_maxWords are not looked for.
+int Instruction::SplitWords(string_view a_line, string_view a_words[], int a_maxWords)
 {
-	for (int i = 0; i < a_instruction.length(); i++)
+	auto isSpace = [](char a_c)
+	{
+		return a_c == ' ' || a_c == '\t' || a_c == '\r' || a_c == '\n' || a_c == '\v' || a_c == '\f';
+	};
+
+	int count = 0;
+	size_t pos = 0;
+	size_t end = a_line.size();
+	while (count < a_maxWords)
 	{
-		if (a_instruction[i] == ';')
+		while (pos < end && isSpace(a_line[pos]))
+		{
+			pos++;
+		}
+		if (pos == end || a_line[pos] == ';')
 		{
-			a_instruction.erase(i, a_instruction.length() - 1);
-			return;
+			break;
 		}
+		size_t start = pos;
+		while (pos < end && !isSpace(a_line[pos]) && a_line[pos] != ';')
+		{
+			pos++;
+		}
+		a_words[count++] = a_line.substr(start, pos - start);
 	}
+	return count;
 }
 
-// Convert the string to lowercase, since op codes do not need to be case sensitive. This makes for
-// easier comparison.
-void Instruction::ConvertToLower(string & a_input)
+// Converts the word passed in into an integer, if it is all digits. A value too large for an int
+// is held at the largest int, which is too large for memory.
+bool Instruction::ConvertToInt(string_view a_parsedWord, int &a_value)
 {
-	for (int i = 0; i < a_input.length(); i++)
+	if (a_parsedWord.empty())
 	{
-		a_input[i] = tolower(a_input[i]);
+		return false;
 	}
-}
-
-// Converts the string passed in into an integer, if possible.
-bool Instruction::ConvertToInt(string a_parsedWord)
-{
-	if (!a_parsedWord.empty())
+	long long value = 0;
+	for (size_t i = 0; i < a_parsedWord.size(); i++)
 	{
-		for (int i = 0; i < a_parsedWord.length(); i++)
+		if (a_parsedWord[i] < '0' || a_parsedWord[i] > '9')
 		{
-			if (a_parsedWord[i] < 48 || a_parsedWord[i] > 57)
-			{
-				return false;
-			}
+			return false;
 		}
-		return true;
+		value = min(value * 10 + (a_parsedWord[i] - '0'), (long long)INT_MAX);
 	}
-	return false;
+	a_value = (int)value;
+	return true;
 }
 
 // Determines if the instruction is an end statement.
-bool Instruction::IsEnd(string a_parsedWord)
+bool Instruction::IsEnd(string_view a_parsedWord)
 {
-	if (a_parsedWord == "end")
-	{
-		return true;
-	}
-	return false;
+	return EqualsIgnoreCase(a_parsedWord, "end");
 }
 
 // Determines if the instruction is machine language.
-bool Instruction::IsMachineLanguage(string a_parsedWord)
+bool Instruction::IsMachineLanguage(string_view a_parsedWord)
 {
-	if (a_parsedWord == "add" ||
-		a_parsedWord == "sub" ||
-		a_parsedWord == "mult" ||
-		a_parsedWord == "div" ||
-		a_parsedWord == "load" ||
-		a_parsedWord == "store" ||
-		a_parsedWord == "read" ||
-		a_parsedWord == "write" ||
-		a_parsedWord == "b" ||
-		a_parsedWord == "bm" ||
-		a_parsedWord == "bz" ||
-		a_parsedWord == "bp" ||
-		a_parsedWord == "halt")
-	{
-		return true;
-	}
-	return false;
+	return FindNumericOpCode(a_parsedWord) != 0;
 }
 
 // Determine if the instruction is assembly language.
-bool Instruction::IsAssemblyLanguage(string a_parsedWord)
+bool Instruction::IsAssemblyLanguage(string_view a_parsedWord)
 {
-	if (a_parsedWord == "dc" || 
-		a_parsedWord == "ds" ||
-		a_parsedWord == "org")
-	{
-		return true;
-	}
-	return false;
+	return EqualsIgnoreCase(a_parsedWord, "dc") ||
+		EqualsIgnoreCase(a_parsedWord, "ds") ||
+		EqualsIgnoreCase(a_parsedWord, "org");
 }
 
 /*
@@ -271,72 +232,30 @@ op code
 
 SYNOPSIS
 
-int Instruction::FindNumericOpCode(string a_parsedWord);
+int Instruction::FindNumericOpCode(string_view a_parsedWord);
 	a_parsedWord -> operation to be translated into op code
 
 DESCRIPTION
 
 This function determines the numerical value of the operation that is passed into
-it. This is done through numerous if statements. Since this function is only called
-once ParseInstruction has determined if the line is assembler or machine language,
-there is no need to spit out a value to say otherwise.
+it, in any case, by looking it up in the table of mnemonics, which are in the order of
+their op codes.
 
 RETURNS
 
-Returns the numerical value of the op code.
+Returns the numerical value of the op code, or 0 if it is not a machine language operation.
 */
-int Instruction::FindNumericOpCode(string a_parsedWord)
+int Instruction::FindNumericOpCode(string_view a_parsedWord)
 {
-	if (a_parsedWord == "add")
-	{
-		return 1;
-	}
-	if (a_parsedWord == "sub")
-	{
-		return 2;
-	}
-	if (a_parsedWord == "mult")
+	static const char *const mnemonics[] = {
+		"add", "sub", "mult", "div", "load", "store", "read", "write", "b", "bm", "bz", "bp", "halt"
+	};
+	for (int opCode = 1; opCode <= 13; opCode++)
 	{
-		return 3;
-	}
-	if (a_parsedWord == "div")
-	{
-		return 4;
-	}
-	if (a_parsedWord == "load")
-	{
-		return 5;
-	}
-	if (a_parsedWord == "store")
-	{
-		return 6;
-	}
-	if (a_parsedWord == "read")
-	{
-		return 7;
-	}
-	if (a_parsedWord == "write")
-	{
-		return 8;
-	}
-	if (a_parsedWord == "b")
-	{
-		return 9;
-	}
-	if (a_parsedWord == "bm")
-	{
-		return 10;
-	}
-	if (a_parsedWord == "bz")
-	{
-		return 11;
-	}
-	if (a_parsedWord == "bp")
-	{
-		return 12;
-	}
-	if (a_parsedWord == "halt")
-	{
-		return 13;
+		if (EqualsIgnoreCase(a_parsedWord, mnemonics[opCode - 1]))
+		{
+			return opCode;
+		}
 	}
+	return 0;
 }
@@ -3,6 +3,8 @@
 //
 #pragma once
 
+#include <string_view>
+
 // The elements of an instruction.
 class Instruction {
 
@@ -18,14 +20,17 @@ public:
 		ST_NotInstr			 // Not a valid instruction.
 	};
 
-	// Parse the Instruction.
-	InstructionType ParseInstruction(string &a_buff);
+	// Parse the Instruction. The parts of it point into the line, which must outlive them.
+	InstructionType ParseInstruction(string_view a_line);
 
 	// Compute the location of the next instruction.
 	int LocationNextInstruction(int a_loc);
 
+	// Determines if a word is the same as a lowercase one, ignoring case.
+	static bool EqualsIgnoreCase(string_view a_word, string_view a_lowercase);
+
 	// To access the label
-	inline string &GetLabel() {
+	inline string_view GetLabel() {
 
 		return m_Label;
 	};
@@ -36,7 +41,7 @@ public:
 	};
 
 	// To access the original statement.
-	inline string &GetOriginalStatement()
+	inline string_view GetOriginalStatement()
 	{
 		return m_instruction;
 	}
@@ -48,13 +53,13 @@ public:
 	}
 
 	// To get the operand.
-	inline string &GetOperand()
+	inline string_view GetOperand()
 	{
 		return m_Operand;
 	}
 
 	// To get the op code.
-	inline string &GetOpCode()
+	inline string_view GetOpCode()
 	{
 		return m_OpCode;
 	}
@@ -79,13 +84,13 @@ public:
 private:
 
 
-	// The elements of an instruction
-	string m_Label;        // The label.
-	string m_OpCode;       // The symbolic op code.
-	string m_Operand;      // The operand.
+	// The elements of an instruction, all pointing into the original line.
+	string_view m_Label;        // The label.
+	string_view m_OpCode;       // The symbolic op code.
+	string_view m_Operand;      // The operand.
 
 
-	string m_instruction;    // The original instruction.
+	string_view m_instruction;    // The original instruction.
 
 							 // Derived values.
 	int m_NumOpCode;     // The numerical value of the op code.
@@ -99,26 +104,23 @@ private:
 	void InitMemVariables();
 
 	// Determines if the line is a comment.
-	bool IsComment(string a_parsedWord);
-
-	// Deletes comments from a line.
-	void DeleteComments(string & a_instruction);
+	bool IsComment(string_view a_line);
 
-	// Converts to lowercase.
-	void ConvertToLower(string & a_input);
+	// Splits the line, up to any comment, into at most a_maxWords words. Returns the number found.
+	static int SplitWords(string_view a_line, string_view a_words[], int a_maxWords);
 
-	// Converts to an integer.
-	bool ConvertToInt(string a_parsedWord);
+	// Converts to an integer, if it is all digits.
+	bool ConvertToInt(string_view a_parsedWord, int &a_value);
 
 	// Determines if the line is an end statement.
-	bool IsEnd(string a_parsedWord);
+	bool IsEnd(string_view a_parsedWord);
 
 	// Determines if the line is a machine language instruction.
-	bool IsMachineLanguage(string a_parsedWord);
+	bool IsMachineLanguage(string_view a_parsedWord);
 
 	// Determines if the line is an assembly language instruction.
-	bool IsAssemblyLanguage(string a_parsedWord);
+	bool IsAssemblyLanguage(string_view a_parsedWord);
 
-	// Finds the numeric op code of the operation.
-	int FindNumericOpCode(string a_parsedWord);
+	// Finds the numeric op code of the operation, or 0 if it is not one.
+	int FindNumericOpCode(string_view a_parsedWord);
 };
\ No newline at end of file
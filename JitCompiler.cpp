@@ -0,0 +1,450 @@
+//
+//		Implementation of the JitCompiler class.
+//
+#include "stdafx.h"
+#include "JitCompiler.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VC_JIT_X64
+#endif
+
+#if defined(VC_JIT_X64) && !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+// Sets up the tables for the memory, but does not allocate the executable buffer until it is needed.
+JitCompiler::JitCompiler(Emulator &a_emulator, int *a_memory, const Emulator::DecodedWord *a_decoded)
+	: m_emulator(a_emulator), m_memory(a_memory), m_decoded(a_decoded), m_code(NULL), m_codeUsed(0), m_emit(NULL),
+	m_entries(Emulator::MEMSZ + 1, (BlockFunction)NULL), m_heat(Emulator::MEMSZ + 1, 0),
+	m_cover(Emulator::MEMSZ + 1, 0), m_trap(Emulator::MEMSZ + 1, 0),
+	m_runningStart(-1), m_runningInvalidated(false)
+{
+	for (int loc = 0; loc <= Emulator::MEMSZ; loc++)
+	{
+		UpdateTrap(loc);
+	}
+}
+
+// Releases the executable buffer.
+JitCompiler::~JitCompiler()
+{
+	if (m_code == NULL) return;
+#if defined(_WIN32)
+	VirtualFree(m_code, 0, MEM_RELEASE);
+#elif defined(VC_JIT_X64)
+	munmap(m_code, CODE_SIZE);
+#endif
+}
+
+// Native code can only be generated for x86-64.
+bool JitCompiler::IsAvailable()
+{
+#if defined(VC_JIT_X64)
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+JitCompiler::RunBlock()
+
+NAME
+
+JitCompiler::RunBlock - runs the translated block that starts at a location
+
+SYNOPSIS
+
+JitCompiler::ExitReason JitCompiler::RunBlock(int a_location, int &a_accumulator, int &a_nextAddress);
+	a_location -> the address the block starts at
+	a_accumulator -> the accumulator, which the block reads and updates
+	a_nextAddress -> receives the address the emulator should go to next
+
+DESCRIPTION
+
+This function looks for a translated block at the location. If there is none, the location
+is counted as visited, and once it has been visited often enough it is translated. The
+block's native code then runs until it reaches a branch, a HALT, or an instruction it cannot
+perform itself (READ, WRITE, or a STORE that would overflow).
+
+RETURNS
+
+Returns the reason the block handed control back, or EXIT_NO_BLOCK if the location has
+not been translated.
+*/
+JitCompiler::ExitReason JitCompiler::RunBlock(int a_location, int &a_accumulator, int &a_nextAddress)
+{
+	BlockFunction function = m_entries[a_location];
+	if (function == NULL)
+	{
+		if (m_heat[a_location] == NEVER || ++m_heat[a_location] < HOT_THRESHOLD)
+		{
+			return EXIT_NO_BLOCK;
+		}
+		if (!CompileBlock(a_location))
+		{
+			m_heat[a_location] = NEVER;
+			return EXIT_NO_BLOCK;
+		}
+		function = m_entries[a_location];
+	}
+
+	Context context;
+	context.memory = m_memory;
+	context.trap = &m_trap[0];
+	context.accumulator = a_accumulator;
+	context.nextAddress = a_location;
+	context.compiler = this;
+	m_runningStart = a_location;
+	m_runningInvalidated = false;
+
+	ExitReason reason = (ExitReason)function(&context);
+	m_runningStart = -1;
+	a_accumulator = context.accumulator;
+	a_nextAddress = context.nextAddress;
+	return reason;
+}
+
+// Performs a STORE that may change what a word decodes to. Returns 1 if the block that is
+// running was thrown away by it, in which case the block must not carry on.
+int JitCompiler::StoreWord(Context *a_context, int a_location)
+{
+	JitCompiler *compiler = a_context->compiler;
+	compiler->m_emulator.WriteMemory(a_location, a_context->accumulator);
+	return compiler->m_runningInvalidated ? 1 : 0;
+}
+
+// Throws away every translated block that contains the word that was written, and notes
+// whether STOREs into it can still be done in native code.
+void JitCompiler::WordChanged(int a_location)
+{
+	for (size_t i = 0; m_cover[a_location] != 0 && i < m_blocks.size(); )
+	{
+		Block &block = m_blocks[i];
+		if (block.start > a_location || block.end < a_location)
+		{
+			i++;
+			continue;
+		}
+		for (int loc = block.start; loc <= block.end; loc++)
+		{
+			m_cover[loc]--;
+			UpdateTrap(loc);
+		}
+		if (block.start == m_runningStart)
+		{
+			m_runningInvalidated = true;
+		}
+		m_entries[block.start] = NULL;
+		m_heat[block.start] = 0;
+		block = m_blocks.back();
+		m_blocks.pop_back();
+	}
+	UpdateTrap(a_location);
+}
+
+/*
+JitCompiler::CompileBlock()
+
+NAME
+
+JitCompiler::CompileBlock - translates a block of VC3600 instructions into x86-64 code
+
+SYNOPSIS
+
+bool JitCompiler::CompileBlock(int a_location);
+	a_location -> the address the block starts at
+
+DESCRIPTION
+
+This function translates the straight line of instructions starting at the location into a
+native function. The accumulator lives in eax, the memory is addressed through r12, and the trap
+table through r13, so that ADD, SUB, MULT, DIV, LOAD and STORE become single instructions on
+memory. The block ends at the first branch, HALT, READ or WRITE. A STORE whose value is too big,
+or a DIV by zero, leaves the block, so that the emulator reports the error. A DIV by -1 negates,
+so that the smallest word wraps around as Emulator::Calculate has it. Otherwise a STORE is
+written directly only when it cannot change what any word decodes to: the value must be small
+enough to be data (below ADDRESS_RADIX), and the word written must be data that is not part of a
+translated block. Any other STORE calls back into the emulator, which re-decodes the word and
+invalidates the blocks that contain it; if that threw away this block, the block leaves. A
+branch back to the start of the block jumps straight to the top of its code.
+
+RETURNS
+
+Returns true if a block was translated. Returns false if the block would have been empty.
+*/
+bool JitCompiler::CompileBlock(int a_location)
+{
+#if defined(VC_JIT_X64)
+	// Allocate the buffer the first time, and start it over when it is nearly full.
+	if (m_code == NULL)
+	{
+#if defined(_WIN32)
+		m_code = (unsigned char *)VirtualAlloc(NULL, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+		void *code = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		m_code = (code == MAP_FAILED) ? NULL : (unsigned char *)code;
+#endif
+		if (m_code == NULL) return false;
+	}
+	if (CODE_SIZE - m_codeUsed < MAX_BLOCK_WORDS * 128 + 64)
+	{
+		Flush();
+	}
+
+	int location = a_location;
+	int words = 0;
+
+	// Skip over any data at the start, and do not translate a block that would be empty.
+	while (m_decoded[location].opCode == Emulator::OP_DATA)
+	{
+		location++;
+	}
+	int opCode = m_decoded[location].opCode;
+	if (opCode == Emulator::OP_READ || opCode == Emulator::OP_WRITE)
+	{
+		return false;
+	}
+
+	unsigned char *start = m_code + m_codeUsed;
+	m_emit = start;
+
+	// push rbx; push r12; push r13
+	Emit(0x53); Emit(0x41); Emit(0x54); Emit(0x41); Emit(0x55);
+#if defined(_WIN32)
+	Emit(0x48); Emit(0x89); Emit(0xCB);		// mov rbx, rcx
+#else
+	Emit(0x48); Emit(0x89); Emit(0xFB);		// mov rbx, rdi
+#endif
+	Emit(0x4C); Emit(0x8B); Emit(0x23);		// mov r12, [rbx]
+	Emit(0x4C); Emit(0x8B); Emit(0x6B); Emit(0x08);	// mov r13, [rbx + 8]
+	Emit(0x8B); Emit(0x43); Emit(0x10);		// mov eax, [rbx + 16]
+	unsigned char *body = m_emit;
+
+	bool ended = false;
+	while (!ended)
+	{
+		const Emulator::DecodedWord &word = m_decoded[location];
+		unsigned char *jump, *slow, *slowTrap, *done;
+
+		if (words == MAX_BLOCK_WORDS)
+		{
+			EmitExit(location, EXIT_CONTINUE);
+			break;
+		}
+
+		switch (word.opCode)
+		{
+		case Emulator::OP_DATA:
+			break;
+		case Emulator::OP_ADD:
+			EmitMemoryOperation(0x03, 0, word.address);		// add eax, [mem]
+			break;
+		case Emulator::OP_SUB:
+			EmitMemoryOperation(0x2B, 0, word.address);		// sub eax, [mem]
+			break;
+		case Emulator::OP_MULT:
+			Emit(0x41); Emit(0x0F); Emit(0xAF); Emit(0x84); Emit(0x24);	// imul eax, [mem]
+			Emit32(word.address * 4);
+			break;
+		case Emulator::OP_DIV:
+			// Leave if the divisor is zero, so that the emulator reports it (cmp dword [mem], 0).
+			EmitMemoryOperation(0x83, 7, word.address); Emit(0x00);
+			jump = EmitShortJump(0x75);						// jne
+			EmitExit(location, EXIT_INTERPRET);
+			PatchShortJump(jump);
+			// Negate instead of dividing by -1, so that the smallest word wraps around as it does in
+			// Emulator::Calculate rather than trapping (cmp dword [mem], -1).
+			EmitMemoryOperation(0x83, 7, word.address); Emit(0xFF);
+			slow = EmitShortJump(0x75);						// jne
+			Emit(0xF7); Emit(0xD8);							// neg eax
+			done = EmitShortJump(0xEB);						// jmp
+			PatchShortJump(slow);
+			Emit(0x99);										// cdq
+			EmitMemoryOperation(0xF7, 7, word.address);		// idiv dword [mem]
+			PatchShortJump(done);
+			break;
+		case Emulator::OP_LOAD:
+			EmitMemoryOperation(0x8B, 0, word.address);		// mov eax, [mem]
+			break;
+		case Emulator::OP_STORE:
+			// The store below may not go through WriteMemory, so the word is marked dirty now.
+			m_emulator.MarkDirty(word.address);
+			m_storeTargets.push_back(word.address);
+			// cmp eax, MAX_WORD and leave if it is too big to store.
+			Emit(0x3D); Emit32(Emulator::MAX_WORD);
+			jump = EmitShortJump(0x7E);						// jle
+			EmitExit(location, EXIT_INTERPRET);
+			PatchShortJump(jump);
+			// Take the slow path if the value could be an instruction, or if the word is code
+			// or has been translated (cmp eax, ADDRESS_RADIX - 1; cmp byte [r13 + address], 0).
+			Emit(0x3D); Emit32(Emulator::ADDRESS_RADIX - 1);
+			slow = EmitShortJump(0x7F);						// jg
+			Emit(0x41); Emit(0x80); Emit(0xBD); Emit32(word.address); Emit(0x00);
+			slowTrap = EmitShortJump(0x75);					// jne
+			EmitMemoryOperation(0x89, 0, word.address);		// mov [mem], eax
+			done = EmitShortJump(0xEB);						// jmp
+			PatchShortJump(slow);
+			PatchShortJump(slowTrap);
+			Emit(0x89); Emit(0x43); Emit(0x10);				// mov [rbx + 16], eax
+#if defined(_WIN32)
+			Emit(0x48); Emit(0x89); Emit(0xD9);				// mov rcx, rbx
+			Emit(0xBA); Emit32(word.address);				// mov edx, address
+#else
+			Emit(0x48); Emit(0x89); Emit(0xDF);				// mov rdi, rbx
+			Emit(0xBE); Emit32(word.address);				// mov esi, address
+#endif
+			Emit(0x48); Emit(0x83); Emit(0xEC); Emit(0x20);	// sub rsp, 32
+			Emit(0x48); Emit(0xB8); Emit64((unsigned long long)&StoreWord);	// mov rax, StoreWord
+			Emit(0xFF); Emit(0xD0);							// call rax
+			Emit(0x48); Emit(0x83); Emit(0xC4); Emit(0x20);	// add rsp, 32
+			Emit(0x85); Emit(0xC0);							// test eax, eax
+			Emit(0x8B); Emit(0x43); Emit(0x10);				// mov eax, [rbx + 16]
+			jump = EmitShortJump(0x74);						// je
+			EmitExit(location + 1, EXIT_CONTINUE);
+			PatchShortJump(jump);
+			PatchShortJump(done);
+			break;
+		case Emulator::OP_READ:
+		case Emulator::OP_WRITE:
+			EmitExit(location, EXIT_INTERPRET);
+			ended = true;
+			break;
+		case Emulator::OP_B:
+			if (word.address == a_location)
+			{
+				Emit(0xE9); Emit32((int)(body - (m_emit + 4)));	// jmp body
+			}
+			else
+			{
+				EmitExit(word.address, EXIT_CONTINUE);
+			}
+			ended = true;
+			break;
+		case Emulator::OP_BM:
+		case Emulator::OP_BZ:
+		case Emulator::OP_BP:
+			Emit(0x85); Emit(0xC0);							// test eax, eax
+			// Jump over the taken path when the condition fails: jge, jne or jle.
+			jump = EmitShortJump(word.opCode == Emulator::OP_BM ? 0x7D :
+				word.opCode == Emulator::OP_BZ ? 0x75 : 0x7E);
+			if (word.address == a_location)
+			{
+				Emit(0xE9); Emit32((int)(body - (m_emit + 4)));	// jmp body
+			}
+			else
+			{
+				EmitExit(word.address, EXIT_CONTINUE);
+			}
+			PatchShortJump(jump);
+			EmitExit(location + 1, EXIT_CONTINUE);
+			ended = true;
+			break;
+		case Emulator::OP_HALT:
+		case Emulator::OP_END:
+			EmitExit(Emulator::MEMSZ, EXIT_HALT);
+			ended = true;
+			break;
+		}
+		if (!ended)
+		{
+			location++;
+			words++;
+		}
+	}
+
+	// Record the block, and trap STOREs into any of the words it covers.
+	Block block;
+	block.start = a_location;
+	block.end = location;
+	block.function = (BlockFunction)start;
+	m_blocks.push_back(block);
+	m_entries[a_location] = block.function;
+	for (int loc = block.start; loc <= block.end; loc++)
+	{
+		m_cover[loc]++;
+		UpdateTrap(loc);
+	}
+	m_codeUsed += (int)(m_emit - start);
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Marks the words that translated STOREs write as dirty again, after the emulator has reset.
+void JitCompiler::MarkStoreTargets()
+{
+	for (size_t i = 0; i < m_storeTargets.size(); i++)
+	{
+		m_emulator.MarkDirty(m_storeTargets[i]);
+	}
+}
+
+// Throws away all of the translated code.
+void JitCompiler::Flush()
+{
+	m_blocks.clear();
+	m_storeTargets.clear();
+	fill(m_entries.begin(), m_entries.end(), (BlockFunction)NULL);
+	fill(m_heat.begin(), m_heat.end(), 0);
+	fill(m_cover.begin(), m_cover.end(), 0);
+	for (int loc = 0; loc <= Emulator::MEMSZ; loc++)
+	{
+		UpdateTrap(loc);
+	}
+	m_codeUsed = 0;
+}
+
+// Emits a 32-bit value, least significant byte first.
+void JitCompiler::Emit32(int a_value)
+{
+	unsigned int value = (unsigned int)a_value;
+	for (int i = 0; i < 4; i++)
+	{
+		Emit((unsigned char)(value >> (i * 8)));
+	}
+}
+
+// Emits a 64-bit value, least significant byte first.
+void JitCompiler::Emit64(unsigned long long a_value)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		Emit((unsigned char)(a_value >> (i * 8)));
+	}
+}
+
+// Emits an instruction whose operand is the memory word at an address, [r12 + address * 4].
+void JitCompiler::EmitMemoryOperation(unsigned char a_opByte, unsigned char a_reg, int a_address)
+{
+	Emit(0x41);
+	Emit(a_opByte);
+	Emit(0x84 | (a_reg << 3));
+	Emit(0x24);
+	Emit32(a_address * 4);
+}
+
+// Emits the code that stores the accumulator, records the next address and returns the reason.
+void JitCompiler::EmitExit(int a_nextAddress, ExitReason a_reason)
+{
+	Emit(0x89); Emit(0x43); Emit(0x10);					// mov [rbx + 16], eax
+	Emit(0xC7); Emit(0x43); Emit(0x14); Emit32(a_nextAddress);	// mov dword [rbx + 20], next
+	Emit(0xB8); Emit32(a_reason);						// mov eax, reason
+	Emit(0x41); Emit(0x5D); Emit(0x41); Emit(0x5C); Emit(0x5B);	// pop r13; pop r12; pop rbx
+	Emit(0xC3);											// ret
+}
+
+// Emits a short conditional jump whose target is filled in by PatchShortJump.
+unsigned char *JitCompiler::EmitShortJump(unsigned char a_opByte)
+{
+	Emit(a_opByte);
+	Emit(0x00);
+	return m_emit - 1;
+}
+
+// Points a short jump at the current position.
+void JitCompiler::PatchShortJump(unsigned char *a_jump)
+{
+	*a_jump = (unsigned char)(m_emit - (a_jump + 1));
+}
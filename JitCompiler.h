@@ -0,0 +1,101 @@
+//
+//		JitCompiler class - translates hot blocks of VC3600 instructions into x86-64 code.
+//
+#pragma once
+
+#include <vector>
+#include "Emulator.h"
+
+class JitCompiler {
+
+public:
+
+	// Why a translated block handed control back to the emulator.
+	enum ExitReason {
+		EXIT_NO_BLOCK,		// There is no translated block at the location (yet).
+		EXIT_CONTINUE,		// Carry on at the next address.
+		EXIT_INTERPRET,		// The instruction at the next address must be interpreted.
+		EXIT_HALT			// The program has finished.
+	};
+
+	// Prepares to translate the program in the emulator's memory.
+	JitCompiler(Emulator &a_emulator, int *a_memory, const Emulator::DecodedWord *a_decoded);
+
+	// Releases the executable memory.
+	~JitCompiler();
+
+	// Determines if native code can be generated on this machine.
+	static bool IsAvailable();
+
+	// Runs the block that starts at a location, translating it first if it has become hot.
+	ExitReason RunBlock(int a_location, int &a_accumulator, int &a_nextAddress);
+
+	// Brings the translation up to date after the emulator has written a word.
+	void WordChanged(int a_location);
+
+	// Marks every word a translated STORE can write as dirty in the emulator.
+	void MarkStoreTargets();
+
+private:
+
+	// The state a translated block reads and writes. The offsets are baked into the code.
+	struct Context {
+		int *memory;				// Offset 0.
+		unsigned char *trap;		// Offset 8.
+		int accumulator;			// Offset 16.
+		int nextAddress;			// Offset 20.
+		JitCompiler *compiler;		// Offset 24.
+	};
+	typedef int(*BlockFunction)(Context *);
+
+	// A translated block and the words that it covers.
+	struct Block {
+		int start;
+		int end;
+		BlockFunction function;
+	};
+
+	const static int HOT_THRESHOLD = 8;			// Visits before a block is translated.
+	const static int MAX_BLOCK_WORDS = 256;		// Longest run of words in one block.
+	const static int CODE_SIZE = 1 << 20;		// Size of the executable buffer.
+	const static unsigned short NEVER = 0xFFFF;	// Heat of a location that cannot be translated.
+
+	Emulator &m_emulator;						// The emulator whose program is translated.
+	int *m_memory;								// The memory of the VC3600.
+	const Emulator::DecodedWord *m_decoded;		// The decoded memory of the VC3600.
+	unsigned char *m_code;						// The executable buffer.
+	int m_codeUsed;								// Bytes of the buffer in use.
+	unsigned char *m_emit;						// Where the next byte of code goes.
+	vector<Block> m_blocks;						// The blocks that are currently valid.
+	vector<BlockFunction> m_entries;			// The block starting at each location.
+	vector<unsigned short> m_heat;				// Visits to each location before translation.
+	vector<unsigned short> m_cover;				// Number of blocks covering each word.
+	vector<unsigned char> m_trap;				// == 1 if a STORE into the word must leave native code.
+	vector<int> m_storeTargets;					// The operands of the translated STOREs.
+	int m_runningStart;							// Start of the block that is running.
+	bool m_runningInvalidated;					// == true if the running block has been thrown away.
+
+	// Recomputes whether a STORE into a word must leave native code.
+	void UpdateTrap(int a_location)
+	{
+		m_trap[a_location] = (m_cover[a_location] != 0 || m_decoded[a_location].opCode != Emulator::OP_DATA) ? 1 : 0;
+	}
+
+	// Lets the emulator perform a STORE on behalf of a block. Called from native code.
+	static int StoreWord(Context *a_context, int a_location);
+
+	// Translates the block starting at a location.
+	bool CompileBlock(int a_location);
+
+	// Throws away every block and starts the buffer over.
+	void Flush();
+
+	// Emits code.
+	void Emit(unsigned char a_byte) { *m_emit++ = a_byte; }
+	void Emit32(int a_value);
+	void Emit64(unsigned long long a_value);
+	void EmitMemoryOperation(unsigned char a_opByte, unsigned char a_reg, int a_address);
+	void EmitExit(int a_nextAddress, ExitReason a_reason);
+	unsigned char *EmitShortJump(unsigned char a_opByte);
+	void PatchShortJump(unsigned char *a_jump);
+};
@@ -0,0 +1,307 @@
+//
+//		Implementation of the LaneEmulator class.
+//
+#include "stdafx.h"
+#include "LaneEmulator.h"
+#include <algorithm>
+
+// Sets every lane up to start at location 0 with the words as they were loaded.
+LaneEmulator::LaneEmulator(shared_ptr<const SharedImage> a_image, int a_lanes)
+	: m_image(a_image), m_laneCount(a_lanes), m_devices(a_lanes, (IODevice *)NULL), m_errors(a_lanes),
+	m_laneAt(a_lanes), m_accumulators(a_lanes, 0), m_laneInstructions(0)
+{
+	// The lanes can only share the decoded program if none of them can change it.
+	const vector<int> &written = m_image->GetWrittenWords();
+	m_lockstep = true;
+	for (size_t slot = 0; slot < written.size(); slot++)
+	{
+		if (m_image->IsRunnable(written[slot]))
+		{
+			m_lockstep = false;
+		}
+	}
+
+	m_words.resize(written.size() * (size_t)a_lanes);
+	for (size_t slot = 0; slot < written.size(); slot++)
+	{
+		fill(m_words.begin() + slot * a_lanes, m_words.begin() + (slot + 1) * a_lanes, m_image->GetMemory(written[slot]));
+	}
+	for (int pos = 0; pos < a_lanes; pos++)
+	{
+		m_laneAt[pos] = pos;
+	}
+}
+
+/*
+LaneEmulator::Run()
+
+NAME
+
+LaneEmulator::Run - runs the program in every lane
+
+SYNOPSIS
+
+void LaneEmulator::Run();
+
+DESCRIPTION
+
+This function runs all of the lanes, each with its own accumulator, written words and I/O
+device, and each producing exactly what Emulator::RunProgram would for its input. Lanes that are
+at the same location are kept next to each other in the state arrays and run as a group, so
+that every arithmetic instruction is one pass over a contiguous run of accumulators and words,
+which the compiler turns into SSE or AVX2 code. When a conditional branch goes both ways, the
+group is split in two. The group that is furthest behind always runs next, one branch at a
+time, so that lanes that have split tend to meet again at the same location, where neighbouring
+groups are joined. A program that can change its own code cannot share its decoded form, so
+its lanes are run one after the other instead.
+*/
+void LaneEmulator::Run()
+{
+	if (!m_lockstep)
+	{
+		RunEachLane();
+		return;
+	}
+
+	Group all = { 0, m_laneCount, 0, false };
+	m_groups.assign(1, all);
+	for (;;)
+	{
+		MergeGroups();
+		int next = -1;
+		for (int group = 0; group < (int)m_groups.size(); group++)
+		{
+			if (!m_groups[group].done && (next < 0 || m_groups[group].address < m_groups[next].address))
+			{
+				next = group;
+			}
+		}
+		if (next < 0)
+		{
+			break;
+		}
+		RunGroup(next);
+	}
+
+	for (int lane = 0; lane < m_laneCount; lane++)
+	{
+		m_devices[lane]->Flush();
+	}
+}
+
+// Runs the instructions of one group, over all of its lanes at once, until it reaches a branch,
+// stops, or splits because some of its lanes failed.
+void LaneEmulator::RunGroup(int a_group)
+{
+	Emulator::Word *accumulator = &m_accumulators[0];
+
+	for (;;)
+	{
+		int address = m_image->NextInstruction(m_groups[a_group].address);
+		int begin = m_groups[a_group].begin;
+		int end = m_groups[a_group].end;
+		const Emulator::DecodedWord &word = m_image->GetDecoded(address);
+		Emulator::Word *row = GetRow(word.address);
+		Emulator::Word value = m_image->GetMemory(word.address);
+		vector<char> flags;
+
+		if (address == Emulator::MEMSZ || word.opCode == Emulator::OP_HALT)
+		{
+			m_laneInstructions += (address == Emulator::MEMSZ) ? 0 : end - begin;
+			m_groups[a_group].done = true;
+			return;
+		}
+		m_laneInstructions += end - begin;
+
+		switch (word.opCode)
+		{
+		case Emulator::OP_ADD:
+			if (row != NULL)
+			{
+				for (int pos = begin; pos < end; pos++) accumulator[pos] = Emulator::Calculate(Emulator::OP_ADD, accumulator[pos], row[pos]);
+			}
+			else
+			{
+				for (int pos = begin; pos < end; pos++) accumulator[pos] = Emulator::Calculate(Emulator::OP_ADD, accumulator[pos], value);
+			}
+			break;
+		case Emulator::OP_SUB:
+			if (row != NULL)
+			{
+				for (int pos = begin; pos < end; pos++) accumulator[pos] = Emulator::Calculate(Emulator::OP_SUB, accumulator[pos], row[pos]);
+			}
+			else
+			{
+				for (int pos = begin; pos < end; pos++) accumulator[pos] = Emulator::Calculate(Emulator::OP_SUB, accumulator[pos], value);
+			}
+			break;
+		case Emulator::OP_MULT:
+			if (row != NULL)
+			{
+				for (int pos = begin; pos < end; pos++) accumulator[pos] = Emulator::Calculate(Emulator::OP_MULT, accumulator[pos], row[pos]);
+			}
+			else
+			{
+				for (int pos = begin; pos < end; pos++) accumulator[pos] = Emulator::Calculate(Emulator::OP_MULT, accumulator[pos], value);
+			}
+			break;
+		case Emulator::OP_DIV:
+			// Lanes that would divide by zero stop here, and the rest carry on.
+			flags.assign(end - begin, 0);
+			for (int pos = begin; pos < end; pos++) flags[pos - begin] = !Emulator::CanDivide(row != NULL ? row[pos] : value);
+			FailLanes(a_group, flags, Emulator::DIVIDE_BY_ZERO_ERROR);
+			end = m_groups[a_group].end;
+			for (int pos = begin; pos < end; pos++) accumulator[pos] = Emulator::Calculate(Emulator::OP_DIV, accumulator[pos], row != NULL ? row[pos] : value);
+			break;
+		case Emulator::OP_LOAD:
+			if (row != NULL)
+			{
+				for (int pos = begin; pos < end; pos++) accumulator[pos] = row[pos];
+			}
+			else
+			{
+				for (int pos = begin; pos < end; pos++) accumulator[pos] = value;
+			}
+			break;
+		case Emulator::OP_STORE:
+			// Lanes whose accumulator is too big stop here, and the rest carry on.
+			flags.assign(end - begin, 0);
+			for (int pos = begin; pos < end; pos++) flags[pos - begin] = !Emulator::CanStore(accumulator[pos]);
+			FailLanes(a_group, flags, Emulator::STORE_TOO_BIG_ERROR);
+			end = m_groups[a_group].end;
+			for (int pos = begin; pos < end; pos++) row[pos] = accumulator[pos];
+			break;
+		case Emulator::OP_READ:
+			for (int pos = begin; pos < end; pos++) row[pos] = (Emulator::Word)m_devices[m_laneAt[pos]]->Read();
+			break;
+		case Emulator::OP_WRITE:
+			for (int pos = begin; pos < end; pos++) m_devices[m_laneAt[pos]]->Write(row != NULL ? row[pos] : value);
+			break;
+		case Emulator::OP_B:
+			m_groups[a_group].address = word.address;
+			return;
+		case Emulator::OP_BM:
+		case Emulator::OP_BZ:
+		case Emulator::OP_BP:
+		{
+			int taken = 0;
+			flags.assign(end - begin, 0);
+			for (int pos = begin; pos < end; pos++)
+			{
+				flags[pos - begin] = Emulator::BranchTaken(word.opCode, accumulator[pos]);
+				taken += flags[pos - begin];
+			}
+			if (taken == 0)
+			{
+				m_groups[a_group].address = address + 1;
+			}
+			else if (taken == end - begin)
+			{
+				m_groups[a_group].address = word.address;
+			}
+			else
+			{
+				SplitGroup(a_group, flags);
+				m_groups[a_group].address = address + 1;
+				m_groups[a_group + 1].address = word.address;
+			}
+			return;
+		}
+		}
+
+		if (begin == end)
+		{
+			return;
+		}
+		m_groups[a_group].address = address + 1;
+	}
+}
+
+// Moves the lanes of a group whose flag is 0 to the front, keeping their order, and those whose
+// flag is 1 after them, into a new group that follows this one. Every row of state is moved.
+// Returns the position the new group starts at.
+int LaneEmulator::SplitGroup(int a_group, const vector<char> &a_flags)
+{
+	int begin = m_groups[a_group].begin;
+	int end = m_groups[a_group].end;
+
+	vector<int> order;
+	for (int i = 0; i < end - begin; i++)
+	{
+		if (!a_flags[i]) order.push_back(i);
+	}
+	int split = begin + (int)order.size();
+	for (int i = 0; i < end - begin; i++)
+	{
+		if (a_flags[i]) order.push_back(i);
+	}
+
+	vector<Emulator::Word> words(end - begin);
+	for (size_t row = 0; row <= m_image->GetWrittenWords().size(); row++)
+	{
+		Emulator::Word *state = (row == 0) ? &m_accumulators[0] : &m_words[(row - 1) * m_laneCount];
+		for (int i = 0; i < end - begin; i++) words[i] = state[begin + order[i]];
+		copy(words.begin(), words.end(), state + begin);
+	}
+	vector<int> lanes(end - begin);
+	for (int i = 0; i < end - begin; i++) lanes[i] = m_laneAt[begin + order[i]];
+	copy(lanes.begin(), lanes.end(), m_laneAt.begin() + begin);
+
+	Group second = m_groups[a_group];
+	second.begin = split;
+	m_groups[a_group].end = split;
+	m_groups.insert(m_groups.begin() + a_group + 1, second);
+	return split;
+}
+
+// Stops the lanes of a group whose flag is 1, recording the error for each. They are split off
+// into a group of their own that is done, and the group keeps the lanes that are still running.
+void LaneEmulator::FailLanes(int a_group, const vector<char> &a_flags, const string &a_error)
+{
+	if (find(a_flags.begin(), a_flags.end(), 1) == a_flags.end())
+	{
+		return;
+	}
+	int split = SplitGroup(a_group, a_flags);
+	m_groups[a_group + 1].done = true;
+	for (int pos = split; pos < m_groups[a_group + 1].end; pos++)
+	{
+		m_errors[m_laneAt[pos]] = a_error;
+	}
+}
+
+// Drops empty groups, and joins neighbours that are both done or are at the same location.
+void LaneEmulator::MergeGroups()
+{
+	vector<Group> merged;
+	for (size_t group = 0; group < m_groups.size(); group++)
+	{
+		const Group &next = m_groups[group];
+		if (next.begin == next.end)
+		{
+			continue;
+		}
+		if (!merged.empty() && merged.back().done == next.done &&
+			(next.done || merged.back().address == next.address))
+		{
+			merged.back().end = next.end;
+			continue;
+		}
+		merged.push_back(next);
+	}
+	m_groups.swap(merged);
+}
+
+// Runs the lanes one at a time, each on an instance of its own.
+void LaneEmulator::RunEachLane()
+{
+	ImageInstance instance(m_image);
+	for (int lane = 0; lane < m_laneCount; lane++)
+	{
+		instance.Reset();
+		if (!instance.Run(*m_devices[lane]))
+		{
+			m_errors[lane] = instance.GetError();
+		}
+	}
+}
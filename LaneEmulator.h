@@ -0,0 +1,74 @@
+//
+//		LaneEmulator class - runs one shared program over many inputs in lockstep.
+//
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "SharedImage.h"
+
+class LaneEmulator {
+
+public:
+
+	// Prepares to run the image in a number of lanes.
+	LaneEmulator(shared_ptr<const SharedImage> a_image, int a_lanes);
+
+	// Selects where READ and WRITE get and send values for one lane.
+	void SetLaneDevice(int a_lane, IODevice *a_device) { m_devices[a_lane] = a_device; }
+
+	// Runs every lane from the start of the program until it stops.
+	void Run();
+
+	// Describes the error that stopped a lane, if any.
+	const string &GetError(int a_lane) const { return m_errors[a_lane]; }
+
+	// The number of instructions run, counting each lane that ran one.
+	long long GetLaneInstructions() const { return m_laneInstructions; }
+
+	// Determines if the lanes run in lockstep, which needs a program that never changes its code.
+	bool IsLockstep() const { return m_lockstep; }
+
+private:
+
+	// A run of lanes, next to each other in the state arrays, that are at the same location.
+	struct Group {
+		int begin;		// The position of the first lane.
+		int end;		// One past the position of the last lane.
+		int address;	// Where the lanes carry on from.
+		bool done;		// == true if the lanes have stopped.
+	};
+
+	shared_ptr<const SharedImage> m_image;	// The program being run.
+	int m_laneCount;						// The number of lanes.
+	bool m_lockstep;						// == true if the lanes can run in lockstep.
+	vector<IODevice *> m_devices;			// Each lane's I/O device, by lane.
+	vector<string> m_errors;				// Why each lane stopped early, by lane.
+	vector<int> m_laneAt;					// The lane held at each position.
+	vector<Emulator::Word> m_accumulators;	// Each position's accumulator.
+	vector<Emulator::Word> m_words;			// The written words, one row of positions for each slot.
+	vector<Group> m_groups;					// The groups, in order of position.
+	long long m_laneInstructions;			// Instructions run, times the lanes that ran them.
+
+	// Runs a group until it branches, stops or splits.
+	void RunGroup(int a_group);
+
+	// Splits a group in two: the positions whose flag is 0, then those whose flag is 1.
+	int SplitGroup(int a_group, const vector<char> &a_flags);
+
+	// Stops the lanes in a group whose flag is 1 with an error.
+	void FailLanes(int a_group, const vector<char> &a_flags, const string &a_error);
+
+	// Joins neighbouring groups that are at the same location.
+	void MergeGroups();
+
+	// Gets the row of positions holding a written word, or NULL if the program never writes it.
+	Emulator::Word *GetRow(int a_location)
+	{
+		int slot = m_image->GetSlot(a_location);
+		return (slot < 0) ? NULL : &m_words[(size_t)slot * m_laneCount];
+	}
+
+	// Runs each lane on its own ImageInstance, for programs that change their own code.
+	void RunEachLane();
+};
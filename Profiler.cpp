@@ -0,0 +1,208 @@
+//
+//		Implementation of the Profiler class.
+//
+#include "stdafx.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <iomanip>
+
+// The symbolic op codes, indexed by numeric op code.
+static const char *const s_opCodeNames[Profiler::OPCODE_COUNT] = {
+	"data", "add", "sub", "mult", "div", "load", "store", "read", "write", "b", "bm", "bz", "bp", "halt"
+};
+
+// The number of entries in each of the report's "hottest" lists.
+static const int TOP_ENTRIES = 10;
+
+// Clears every count. The arrays are only allocated once profiling is turned on.
+void Profiler::Reset(int a_memorySize)
+{
+	m_executions.assign(a_memorySize, 0);
+	m_taken.assign(a_memorySize, 0);
+	m_notTaken.assign(a_memorySize, 0);
+	m_targets.assign(a_memorySize, -1);
+	m_reads.assign(a_memorySize, 0);
+	m_writes.assign(a_memorySize, 0);
+	fill(m_opCodes, m_opCodes + OPCODE_COUNT, 0);
+}
+
+// Names every location by the nearest symbol at or before it. Locations before the first
+// symbol have no name. Multiply defined symbols have no location, and are left out.
+vector<string> Profiler::NameLocations(int a_memorySize, const map<string, int, less<>> &a_symbols)
+{
+	vector<string> exact(a_memorySize);
+	for (map<string, int, less<>>::const_iterator it = a_symbols.begin(); it != a_symbols.end(); it++)
+	{
+		if (it->second >= 0 && it->second < a_memorySize && exact[it->second].empty())
+		{
+			exact[it->second] = it->first;
+		}
+	}
+
+	vector<string> names(a_memorySize);
+	int base = -1;
+	for (int loc = 0; loc < a_memorySize; loc++)
+	{
+		if (!exact[loc].empty())
+		{
+			base = loc;
+		}
+		if (base >= 0)
+		{
+			names[loc] = exact[base];
+			if (loc != base)
+			{
+				names[loc] += "+" + to_string(loc - base);
+			}
+		}
+	}
+	return names;
+}
+
+/*
+Profiler::Report()
+
+NAME
+
+Profiler::Report - prints what the profiled runs of the program did
+
+SYNOPSIS
+
+void Profiler::Report(ostream &a_out, const vector<SourceLine> &a_source, const map<string, int, less<>> &a_symbols) const;
+	a_out -> where the report is printed
+	a_source -> the source line each location was assembled from
+	a_symbols -> the symbols of the program and their locations
+
+DESCRIPTION
+
+This function prints the counts collected since the profiler was last reset: the instructions
+executed with each op code, the hottest instructions, how often each branch was taken and
+fell through, the most read and written words, and the hottest loops. A loop is a branch
+that was taken back to its own or an earlier location. Its iterations are the times the
+branch was taken, and its cost is every instruction executed from the target to the branch,
+so a loop's cost includes any loops nested inside it. Every location is shown with the
+symbol at or before it and the line of source it came from.
+*/
+void Profiler::Report(ostream &a_out, const vector<SourceLine> &a_source, const map<string, int, less<>> &a_symbols) const
+{
+	int memorySize = (int)m_executions.size();
+	vector<string> names = NameLocations(memorySize, a_symbols);
+	long long total = 0;
+	for (int op = 0; op < OPCODE_COUNT; op++)
+	{
+		total += m_opCodes[op];
+	}
+
+	// Describes a location by its name and the source line it came from.
+	auto describe = [&](int a_location)
+	{
+		string text = names[a_location];
+		if (a_location < (int)a_source.size() && a_source[a_location].lineNumber != 0)
+		{
+			text += "\tline " + to_string(a_source[a_location].lineNumber) + ": " + a_source[a_location].statement;
+		}
+		return text;
+	};
+	auto share = [&](long long a_count)
+	{
+		ostringstream text;
+		text << fixed << setprecision(1) << (total == 0 ? 0.0 : 100.0 * a_count / total) << "%";
+		return text.str();
+	};
+
+	a_out << "Profile of the program:" << endl;
+	a_out << endl;
+	a_out << total << " instructions executed." << endl;
+	a_out << endl;
+
+	a_out << "Op code\tCount\tShare" << endl;
+	for (int op = 1; op < OPCODE_COUNT; op++)
+	{
+		if (m_opCodes[op] != 0)
+		{
+			a_out << s_opCodeNames[op] << "\t" << m_opCodes[op] << "\t" << share(m_opCodes[op]) << endl;
+		}
+	}
+	a_out << endl;
+
+	// The hottest instructions, most executed first.
+	vector<int> locations;
+	for (int loc = 0; loc < memorySize; loc++)
+	{
+		if (m_executions[loc] != 0)
+		{
+			locations.push_back(loc);
+		}
+	}
+	stable_sort(locations.begin(), locations.end(),
+		[&](int a_first, int a_second) { return m_executions[a_first] > m_executions[a_second]; });
+	a_out << "Hottest instructions:" << endl;
+	a_out << "Location\tCount\tShare\tSymbol" << endl;
+	for (int i = 0; i < (int)locations.size() && i < TOP_ENTRIES; i++)
+	{
+		int loc = locations[i];
+		a_out << loc << "\t\t" << m_executions[loc] << "\t" << share(m_executions[loc]) << "\t" << describe(loc) << endl;
+	}
+	a_out << endl;
+
+	a_out << "Branches:" << endl;
+	a_out << "Location\tTaken\tNot taken\tSymbol" << endl;
+	for (int loc = 0; loc < memorySize; loc++)
+	{
+		if (m_taken[loc] != 0 || m_notTaken[loc] != 0)
+		{
+			a_out << loc << "\t\t" << m_taken[loc] << "\t" << m_notTaken[loc] << "\t\t" << describe(loc) << endl;
+		}
+	}
+	a_out << endl;
+
+	// The words with the most reads and writes between them.
+	locations.clear();
+	for (int loc = 0; loc < memorySize; loc++)
+	{
+		if (m_reads[loc] != 0 || m_writes[loc] != 0)
+		{
+			locations.push_back(loc);
+		}
+	}
+	stable_sort(locations.begin(), locations.end(), [&](int a_first, int a_second)
+		{ return m_reads[a_first] + m_writes[a_first] > m_reads[a_second] + m_writes[a_second]; });
+	a_out << "Most used words:" << endl;
+	a_out << "Location\tReads\tWrites\tSymbol" << endl;
+	for (int i = 0; i < (int)locations.size() && i < TOP_ENTRIES; i++)
+	{
+		int loc = locations[i];
+		a_out << loc << "\t\t" << m_reads[loc] << "\t" << m_writes[loc] << "\t" << describe(loc) << endl;
+	}
+	a_out << endl;
+
+	// Every backward branch that was taken closes a loop.
+	struct Loop {
+		int top;
+		int bottom;
+		long long cost;
+	};
+	vector<Loop> loops;
+	for (int loc = 0; loc < memorySize; loc++)
+	{
+		int top = m_targets[loc];
+		if (m_taken[loc] != 0 && top >= 0 && top <= loc)
+		{
+			Loop loop = { top, loc, 0 };
+			for (int body = top; body <= loc; body++)
+			{
+				loop.cost += m_executions[body];
+			}
+			loops.push_back(loop);
+		}
+	}
+	stable_sort(loops.begin(), loops.end(), [](const Loop &a_first, const Loop &a_second) { return a_first.cost > a_second.cost; });
+	a_out << "Hottest loops:" << endl;
+	a_out << "From\tTo\tIterations\tInstructions\tShare\tSymbol" << endl;
+	for (int i = 0; i < (int)loops.size() && i < TOP_ENTRIES; i++)
+	{
+		const Loop &loop = loops[i];
+		a_out << loop.top << "\t" << loop.bottom << "\t" << m_taken[loop.bottom] << "\t\t" << loop.cost << "\t\t"
+			<< share(loop.cost) << "\t" << describe(loop.top) << endl;
+	}
+}
@@ -0,0 +1,98 @@
+//
+//		Profiler class - counts what a VC3600 program does while it runs.
+//
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Define VC_NO_PROFILER to leave the profiling code out of the emulator altogether.
+#ifdef VC_NO_PROFILER
+#define VC_PROFILER 0
+#else
+#define VC_PROFILER 1
+#endif
+
+// Where a word of the program came from, so that a profile can be reported against the source.
+struct SourceLine {
+	int lineNumber = 0;	// The line of the source file, or 0 if nothing was assembled there.
+	string statement;	// The original statement.
+};
+
+class Profiler {
+
+public:
+
+	// The number of op codes counted, including 0 for data.
+	static const int OPCODE_COUNT = 14;
+
+	// Clears every count, for a memory of the given size.
+	void Reset(int a_memorySize);
+
+	// Determines if there are no counts at all.
+	bool IsEmpty() const { return m_executions.empty(); }
+
+	// Counts one execution of the instruction at a location, and the word its operand reads or writes.
+	void CountStep(int a_location, int a_opCode, int a_operand)
+	{
+		m_executions[a_location]++;
+		m_opCodes[a_opCode]++;
+		if (a_operand >= (int)m_reads.size())
+		{
+			return;
+		}
+		if ((a_opCode >= 1 && a_opCode <= 5) || a_opCode == 8)	// ADD to LOAD, and WRITE.
+		{
+			m_reads[a_operand]++;
+		}
+		else if (a_opCode == 6 || a_opCode == 7)	// STORE and READ.
+		{
+			m_writes[a_operand]++;
+		}
+	}
+
+	// Counts whether the branch at a location was taken, and where to.
+	void CountBranch(int a_location, bool a_taken, int a_target)
+	{
+		if (a_taken)
+		{
+			m_taken[a_location]++;
+			m_targets[a_location] = a_target;
+		}
+		else
+		{
+			m_notTaken[a_location]++;
+		}
+	}
+
+	// Gets the number of times the word at a location was executed.
+	long long GetExecutions(int a_location) const
+	{
+		return (a_location < (int)m_executions.size()) ? m_executions[a_location] : 0;
+	}
+
+	// Sets the number of times the word at a location was executed, as read from a saved profile.
+	void SetExecutions(int a_location, long long a_count) { m_executions[a_location] = a_count; }
+
+	// Prints the counts, with each location labelled by its symbol and source line.
+	void Report(ostream &a_out, const vector<SourceLine> &a_source, const map<string, int, less<>> &a_symbols) const;
+
+private:
+
+	vector<long long> m_executions;			// The times each word was executed.
+	vector<long long> m_taken;				// The times each branch was taken.
+	vector<long long> m_notTaken;			// The times each branch fell through.
+	vector<int> m_targets;					// Where each branch last went, or -1.
+	vector<long long> m_reads;				// The times each word was read by an operand.
+	vector<long long> m_writes;				// The times each word was written by STORE or READ.
+	long long m_opCodes[OPCODE_COUNT] = {};	// The instructions executed with each op code.
+
+	// Names each location by the symbol at or before it, such as "loop" or "loop+2".
+	static vector<string> NameLocations(int a_memorySize, const map<string, int, less<>> &a_symbols);
+};
+
+#endif
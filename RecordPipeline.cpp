@@ -0,0 +1,211 @@
+//
+//		Implementation of the RecordPipeline class.
+//
+#include "stdafx.h"
+#include "RecordPipeline.h"
+#include "Errors.h"
+#include <cstring>
+#include <thread>
+
+// Feeds the values of one record to READ, and collects what WRITE sends.
+class RecordDevice : public IODevice {
+
+public:
+
+	// Starts a run on the values from a_next up to a_end, adding the output to a_output.
+	void Start(const long long *a_next, const long long *a_end, vector<long long> *a_output)
+	{
+		m_next = a_next;
+		m_end = a_end;
+		m_output = a_output;
+	}
+
+	long long Read() { return (m_next != m_end) ? *m_next++ : 0; }
+	void Write(long long a_value) { m_output->push_back(a_value); }
+
+private:
+
+	const long long *m_next = NULL;		// The next value for READ.
+	const long long *m_end = NULL;		// Past the record's last value.
+	vector<long long> *m_output = NULL;	// Where the output goes.
+};
+
+/*
+RecordPipeline::Run()
+
+NAME
+
+RecordPipeline::Run - runs the program once for every record in a stream
+
+SYNOPSIS
+
+void RecordPipeline::Run(istream &a_in, ostream &a_out);
+	a_in -> the records, one to a line
+	a_out -> where the results go, one line for each record
+
+DESCRIPTION
+
+This function runs the three stages of the pipeline at once: a thread reads and parses the
+records, this thread runs the program on them, and another formats and writes the results.
+The stages pass batches of records to each other through bounded queues, so a stage that gets
+ahead waits for the next one instead of holding the whole stream in memory. Each stage works
+through the batches in order, so the results come out in the order the records went in.
+
+A record is the integers on one line, which are the values READ gets; a blank line is a record
+with no values. Its result is what the program wrote, separated by spaces, followed by the error
+that stopped it, if any.
+*/
+void RecordPipeline::Run(istream &a_in, ostream &a_out)
+{
+	thread reader(&RecordPipeline::ReadRecords, this, ref(a_in));
+	thread writer(&RecordPipeline::WriteResults, this, ref(a_out));
+	RunRecords();
+	reader.join();
+	writer.join();
+}
+
+// Reads the stream a large block at a time and parses each line into a record, holding on to
+// the start of a line that runs past the end of a block.
+void RecordPipeline::ReadRecords(istream &a_in)
+{
+	vector<char> block(1 << 20);
+	string partial;
+	Batch batch;
+
+	auto addRecord = [&](const char *a_text, size_t a_length)
+	{
+		ParseIntegers(a_text, a_length, batch.values);
+		batch.ends.push_back(batch.values.size());
+		if (batch.ends.size() == BATCH_RECORDS)
+		{
+			m_records.Push(move(batch));
+			batch = Batch();
+		}
+	};
+
+	while (a_in.read(block.data(), block.size()) || a_in.gcount() > 0)
+	{
+		const char *pos = block.data();
+		const char *end = pos + a_in.gcount();
+		for (;;)
+		{
+			const char *newline = (const char *)memchr(pos, '\n', end - pos);
+			if (newline == NULL)
+			{
+				partial.append(pos, end);
+				break;
+			}
+			if (partial.empty())
+			{
+				addRecord(pos, newline - pos);
+			}
+			else
+			{
+				partial.append(pos, newline);
+				addRecord(partial.data(), partial.size());
+				partial.clear();
+			}
+			pos = newline + 1;
+		}
+	}
+	if (!partial.empty())
+	{
+		addRecord(partial.data(), partial.size());
+	}
+	if (!batch.ends.empty())
+	{
+		m_records.Push(move(batch));
+	}
+	m_records.Close();
+}
+
+// Runs the program on each record, going back to the snapshot of the loaded program after each.
+void RecordPipeline::RunRecords()
+{
+	RecordDevice device;
+	m_emul.SetIODevice(&device);
+	m_emul.TakeSnapshot();
+
+	Batch records;
+	while (m_records.Pop(records))
+	{
+		Batch results;
+		results.errors.resize(records.ends.size());
+		size_t start = 0;
+		for (size_t record = 0; record < records.ends.size(); record++)
+		{
+			device.Start(records.values.data() + start, records.values.data() + records.ends[record], &results.values);
+			Errors::InitErrorReporting();
+			if (!m_emul.RunProgram())
+			{
+				const vector<string> &errors = Errors::GetErrors();
+				for (size_t i = 0; i < errors.size(); i++)
+				{
+					results.errors[record] += (i == 0 ? "" : " ") + errors[i];
+				}
+				if (results.errors[record].empty())
+				{
+					results.errors[record] = "ERROR: The program did not run to the end!";
+				}
+				m_failureCount++;
+			}
+			m_emul.ResetToSnapshot();
+			results.ends.push_back(results.values.size());
+			start = records.ends[record];
+		}
+		m_recordCount += records.ends.size();
+		m_results.Push(move(results));
+	}
+	m_results.Close();
+	m_emul.SetIODevice(NULL);
+}
+
+// Formats a batch of results at a time into one buffer, and writes it all at once.
+void RecordPipeline::WriteResults(ostream &a_out)
+{
+	string text;
+	Batch results;
+	while (m_results.Pop(results))
+	{
+		text.clear();
+		size_t start = 0;
+		for (size_t record = 0; record < results.ends.size(); record++)
+		{
+			for (size_t i = start; i < results.ends[record]; i++)
+			{
+				if (i != start)
+				{
+					text += ' ';
+				}
+
+				// Write the digits backwards into a scratch area, then copy them over in order.
+				char digits[24];
+				int count = 0;
+				long long value = results.values[i];
+				unsigned long long magnitude = (value < 0) ? 0 - (unsigned long long)value : (unsigned long long)value;
+				do
+				{
+					digits[count++] = (char)('0' + magnitude % 10);
+					magnitude /= 10;
+				} while (magnitude != 0);
+				if (value < 0)
+				{
+					text += '-';
+				}
+				while (count > 0)
+				{
+					text += digits[--count];
+				}
+			}
+			if (!results.errors[record].empty())
+			{
+				text += (results.ends[record] != start) ? " " : "";
+				text += results.errors[record];
+			}
+			text += '\n';
+			start = results.ends[record];
+		}
+		a_out.write(text.data(), text.size());
+	}
+	a_out.flush();
+}
@@ -0,0 +1,56 @@
+//
+//		RecordPipeline class - runs a program once for every line of a stream of input records.
+//
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Emulator.h"
+#include "BoundedQueue.h"
+
+class RecordPipeline {
+
+public:
+
+	// Prepares to run the program loaded into the emulator. The emulator's snapshot is taken
+	// when Run starts, and memory goes back to it after every record.
+	RecordPipeline(Emulator &a_emul) : m_emul(a_emul), m_records(QUEUE_BATCHES), m_results(QUEUE_BATCHES) {}
+
+	// Runs the program once for each line of a_in, and writes one line of results to a_out for
+	// each, in the same order.
+	void Run(istream &a_in, ostream &a_out);
+
+	// The records run, and how many of them stopped with an error.
+	long long GetRecordCount() const { return m_recordCount; }
+	long long GetFailureCount() const { return m_failureCount; }
+
+private:
+
+	// The records handed from one stage to the next at a time, and the batches each queue holds.
+	static const size_t BATCH_RECORDS = 4096;
+	static const size_t QUEUE_BATCHES = 8;
+
+	// A run of consecutive records, or of their results. Record i's values are values[ends[i - 1]]
+	// up to values[ends[i]].
+	struct Batch {
+		vector<long long> values;	// The values for READ, or the values sent by WRITE.
+		vector<size_t> ends;		// Where each record's values end.
+		vector<string> errors;		// What stopped each run, or empty if it ran to the end.
+	};
+
+	Emulator &m_emul;					// Runs the program.
+	BoundedQueue<Batch> m_records;		// The records read, waiting to be run.
+	BoundedQueue<Batch> m_results;		// The results, waiting to be written.
+	long long m_recordCount = 0;		// The records run so far.
+	long long m_failureCount = 0;		// The runs that stopped with an error.
+
+	// Reads lines from the stream and parses them into batches of records.
+	void ReadRecords(istream &a_in);
+
+	// Runs the program on every record, and passes on what it wrote.
+	void RunRecords();
+
+	// Formats the results a line at a time and writes them out.
+	void WriteResults(ostream &a_out);
+};
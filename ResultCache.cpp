@@ -0,0 +1,189 @@
+//
+//		Implementation of the ResultCache class.
+//
+#include "stdafx.h"
+#include "ResultCache.h"
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
+// The 64-bit FNV-1a hash.
+static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+// Adds the bytes of a value to a running FNV-1a hash.
+static void HashValue(unsigned long long &a_hash, unsigned long long a_value, int a_bytes)
+{
+	for (int i = 0; i < a_bytes; i++)
+	{
+		a_hash = (a_hash ^ ((a_value >> (8 * i)) & 0xff)) * FNV_PRIME;
+	}
+}
+
+// The first line of every result file.
+static const char s_fileHeader[] = "VC3600 result 1";
+
+// Hashes every word of memory, along with the size of memory and of a word, so that a program
+// only matches itself on the same configuration.
+unsigned long long ResultCache::HashImage(const Emulator &a_emul)
+{
+	unsigned long long hash = FNV_OFFSET;
+	HashValue(hash, Emulator::MEMSZ, 8);
+	HashValue(hash, sizeof(Emulator::Word), 8);
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		HashValue(hash, (unsigned long long)a_emul.GetMemory(loc), sizeof(Emulator::Word));
+	}
+	return hash;
+}
+
+// Makes a key from the program's hash, a hash of the values for READ, and the number of values.
+// The key is also the name of the result's file.
+string ResultCache::MakeKey(unsigned long long a_imageHash, const vector<long long> &a_input)
+{
+	unsigned long long hash = FNV_OFFSET;
+	for (size_t i = 0; i < a_input.size(); i++)
+	{
+		HashValue(hash, (unsigned long long)a_input[i], 8);
+	}
+	ostringstream key;
+	key << hex << setfill('0') << setw(16) << a_imageHash << "-" << setw(16) << hash << "-" << dec << a_input.size();
+	return key.str();
+}
+
+/*
+ResultCache::Find()
+
+NAME
+
+ResultCache::Find - looks for the result of an earlier run of a program on the same input
+
+SYNOPSIS
+
+bool ResultCache::Find(const string &a_key, ResultCache::Result &a_result);
+	a_key -> the key made by MakeKey for the program and input
+	a_result -> the result that was found
+
+DESCRIPTION
+
+This function looks in the memory tier first, where a hit makes the result the most recently
+used. Failing that, it looks for the result's file, and a hit there is brought into the memory
+tier. Every lookup is counted as a hit, a hit on disk, or a miss, for the hit rate.
+
+RETURNS
+
+Returns true if the result was found, false otherwise.
+*/
+bool ResultCache::Find(const string &a_key, Result &a_result)
+{
+	map<string, EntryList::iterator>::iterator found = m_index.find(a_key);
+	if (found != m_index.end())
+	{
+		m_entries.splice(m_entries.begin(), m_entries, found->second);
+		a_result = found->second->second;
+		m_hits++;
+		return true;
+	}
+	if (!m_directory.empty() && ReadFile(a_key, a_result))
+	{
+		Remember(a_key, a_result);
+		m_hits++;
+		m_diskHits++;
+		return true;
+	}
+	m_misses++;
+	return false;
+}
+
+// Keeps the result in memory and, if there is a directory, in its file.
+void ResultCache::Store(const string &a_key, const Result &a_result)
+{
+	Remember(a_key, a_result);
+	if (!m_directory.empty())
+	{
+		WriteFile(a_key, a_result);
+	}
+}
+
+// Puts the result at the front of the list of results in memory, replacing any result already
+// kept for the key, and drops the least recently used result if there are too many.
+void ResultCache::Remember(const string &a_key, const Result &a_result)
+{
+	map<string, EntryList::iterator>::iterator found = m_index.find(a_key);
+	if (found != m_index.end())
+	{
+		m_entries.erase(found->second);
+		m_index.erase(found);
+	}
+	if (m_capacity == 0)
+	{
+		return;
+	}
+	m_entries.push_front(make_pair(a_key, a_result));
+	m_index[a_key] = m_entries.begin();
+	if (m_entries.size() > m_capacity)
+	{
+		m_index.erase(m_entries.back().first);
+		m_entries.pop_back();
+	}
+}
+
+// Reads a result file: the header, whether the run succeeded, the number of errors and each error
+// on a line of its own, then the number of bytes of output and the output itself.
+bool ResultCache::ReadFile(const string &a_key, Result &a_result) const
+{
+	ifstream file(FileName(a_key).c_str(), ios::in | ios::binary);
+	string header;
+	if (!file || !getline(file, header) || header != s_fileHeader)
+	{
+		return false;
+	}
+
+	int succeeded = 0;
+	size_t errorCount = 0, outputSize = 0;
+	if (!(file >> succeeded >> errorCount) || file.get() != '\n')
+	{
+		return false;
+	}
+	a_result.succeeded = (succeeded != 0);
+	a_result.errors.resize(errorCount);
+	for (size_t i = 0; i < errorCount; i++)
+	{
+		if (!getline(file, a_result.errors[i]))
+		{
+			return false;
+		}
+	}
+	if (!(file >> outputSize) || file.get() != '\n')
+	{
+		return false;
+	}
+	a_result.output.resize(outputSize);
+	return outputSize == 0 || file.read(&a_result.output[0], outputSize);
+}
+
+// Writes a result file under a temporary name and then renames it, so that a run that is stopped
+// part of the way through never leaves a broken file behind.
+void ResultCache::WriteFile(const string &a_key, const Result &a_result) const
+{
+	string fileName = FileName(a_key);
+	string tempName = fileName + ".tmp";
+	{
+		ofstream file(tempName.c_str(), ios::out | ios::binary | ios::trunc);
+		file << s_fileHeader << "\n";
+		file << (a_result.succeeded ? 1 : 0) << " " << a_result.errors.size() << "\n";
+		for (size_t i = 0; i < a_result.errors.size(); i++)
+		{
+			file << a_result.errors[i] << "\n";
+		}
+		file << a_result.output.size() << "\n";
+		file.write(a_result.output.data(), a_result.output.size());
+		if (!file)
+		{
+			remove(tempName.c_str());
+			return;
+		}
+	}
+	remove(fileName.c_str());
+	rename(tempName.c_str(), fileName.c_str());
+}
@@ -0,0 +1,71 @@
+//
+//		ResultCache class - remembers what a program printed for an input, so it need not run again.
+//
+#pragma once
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include "Emulator.h"
+
+class ResultCache {
+
+public:
+
+	// What one run of a program produced.
+	struct Result {
+		bool succeeded = false;	// == true if the program ran without an error.
+		string output;			// Everything WRITE sent.
+		vector<string> errors;	// The errors recorded, if it did not succeed.
+	};
+
+	// Selects the number of results kept in memory, and the directory that every result is also
+	// kept in files in. With no directory, results are only kept in memory.
+	void Configure(size_t a_entries, const string &a_directory)
+	{
+		m_capacity = a_entries;
+		m_directory = a_directory;
+	}
+
+	// Hashes the memory of an emulator, as the program's part of a key.
+	static unsigned long long HashImage(const Emulator &a_emul);
+
+	// Makes the key for a run of a program on the given values for READ.
+	static string MakeKey(unsigned long long a_imageHash, const vector<long long> &a_input);
+
+	// Looks for the result of a run, in memory and then on disk. Returns true if it was found.
+	bool Find(const string &a_key, Result &a_result);
+
+	// Keeps the result of a run, in memory and on disk.
+	void Store(const string &a_key, const Result &a_result);
+
+	// The number of lookups that found a result, that found it on disk, and that found nothing.
+	long long GetHits() const { return m_hits; }
+	long long GetDiskHits() const { return m_diskHits; }
+	long long GetMisses() const { return m_misses; }
+
+private:
+
+	typedef list<pair<string, Result>> EntryList;
+
+	size_t m_capacity = 256;	// The most results kept in memory.
+	string m_directory;			// Where the result files are kept, or empty for none.
+	EntryList m_entries;	// The results in memory, most recently used first.
+	map<string, EntryList::iterator> m_index;	// Where each key's result is in m_entries.
+	long long m_hits = 0;		// Lookups that found a result.
+	long long m_diskHits = 0;	// Lookups that found a result on disk but not in memory.
+	long long m_misses = 0;		// Lookups that found nothing.
+
+	// Puts a result at the front of the memory tier, dropping the least recently used if it is full.
+	void Remember(const string &a_key, const Result &a_result);
+
+	// Gets the name of the file that holds a key's result.
+	string FileName(const string &a_key) const { return m_directory + "/" + a_key + ".vcr"; }
+
+	// Reads a result from its file.
+	bool ReadFile(const string &a_key, Result &a_result) const;
+
+	// Writes a result to its file.
+	void WriteFile(const string &a_key, const Result &a_result) const;
+};
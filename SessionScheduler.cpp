@@ -0,0 +1,110 @@
+//
+//		Implementation of the SessionScheduler class.
+//
+#include "stdafx.h"
+#include "SessionScheduler.h"
+
+// Starts a session, in line for its first turn.
+int SessionScheduler::AddSession()
+{
+	int session = (int)m_sessions.size();
+	m_sessions.push_back(unique_ptr<Session>(new Session(m_image)));
+	m_sessions[session]->queued = true;
+	m_ready.push_back(session);
+	return session;
+}
+
+// Queues the value, and wakes the session if it was waiting.
+void SessionScheduler::Push(int a_session, long long a_value)
+{
+	m_sessions[a_session]->device.Push(a_value);
+	Wake(a_session);
+}
+
+// Closes the session's input, and wakes the session if it was waiting.
+void SessionScheduler::CloseInput(int a_session)
+{
+	m_sessions[a_session]->device.CloseInput();
+	Wake(a_session);
+}
+
+// Puts a waiting session at the back of the line.
+void SessionScheduler::Wake(int a_session)
+{
+	Session &session = *m_sessions[a_session];
+	if (session.state == ImageInstance::RUN_WAITING && !session.queued)
+	{
+		session.queued = true;
+		m_ready.push_back(a_session);
+	}
+}
+
+/*
+SessionScheduler::RunRound()
+
+NAME
+
+SessionScheduler::RunRound - gives each session that is ready one turn
+
+SYNOPSIS
+
+bool SessionScheduler::RunRound();
+
+DESCRIPTION
+
+This function gives every session in line one turn, in order, and then returns, so that the
+caller can hand out input between rounds. A turn runs the session's program on from where it
+was set aside (see ImageInstance::RunSlice) for at most the scheduler's fuel. A session that uses
+up its fuel goes to the back of the line for the next round, so a program stuck in a loop gets
+one turn in each round and the others still get theirs. If it has run the session fuel without
+halting or waiting for input, it is stopped with an error instead. A session that reaches a
+READ with no value waiting leaves the line until Push or CloseInput wakes it. A session that
+finishes leaves the line for good.
+
+RETURNS
+
+Returns true if any session had a turn, false if none were ready.
+*/
+bool SessionScheduler::RunRound()
+{
+	if (m_ready.empty())
+	{
+		return false;
+	}
+	for (size_t turns = m_ready.size(); turns > 0; turns--)
+	{
+		int number = m_ready.front();
+		m_ready.pop_front();
+		Session &session = *m_sessions[number];
+		session.queued = false;
+
+		long long fuel = m_fuel;
+		if (m_sessionFuel != 0 && (fuel == 0 || fuel > m_sessionFuel - session.busy))
+		{
+			fuel = m_sessionFuel - session.busy;
+		}
+		session.state = session.instance.RunSlice(session.device, fuel);
+		m_turns++;
+		if (session.state == ImageInstance::RUN_PREEMPTED)
+		{
+			m_preemptions++;
+			session.busy += fuel;
+			if (m_sessionFuel != 0 && session.busy >= m_sessionFuel)
+			{
+				session.error = "ERROR: The session ran " + to_string(m_sessionFuel) +
+					" instructions without halting or waiting for input!";
+				session.state = ImageInstance::RUN_FAILED;
+				session.device.Flush();
+				continue;
+			}
+			session.queued = true;
+			m_ready.push_back(number);
+		}
+		else if (session.state == ImageInstance::RUN_WAITING)
+		{
+			m_waits++;
+			session.busy = 0;
+		}
+	}
+	return true;
+}
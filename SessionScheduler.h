@@ -0,0 +1,82 @@
+//
+//		SessionScheduler class - takes turns running many interactive programs on one thread.
+//
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include "SharedImage.h"
+
+class SessionScheduler {
+
+public:
+
+	// Prepares to run sessions of the image, each for at most a_fuel instructions a turn. A session
+	// that runs a_sessionFuel instructions without halting or waiting for input is stopped with an
+	// error (0 for no limit).
+	SessionScheduler(shared_ptr<const SharedImage> a_image, long long a_fuel, long long a_sessionFuel)
+		: m_image(a_image), m_fuel(a_fuel), m_sessionFuel(a_sessionFuel) {}
+
+	// Starts a new session at the start of the program. Returns its number.
+	int AddSession();
+
+	// Gives a session a value for READ, waking it if it was waiting for one.
+	void Push(int a_session, long long a_value);
+
+	// Notes that a session will get no more values, waking it if it was waiting for one.
+	void CloseInput(int a_session);
+
+	// Gives every session that is ready one turn. Returns false if none were ready.
+	bool RunRound();
+
+	// Determines if a session has finished, with or without an error.
+	bool IsFinished(int a_session) const
+	{
+		ImageInstance::RunState state = m_sessions[a_session]->state;
+		return state == ImageInstance::RUN_DONE || state == ImageInstance::RUN_FAILED;
+	}
+
+	// Determines if a session is at a READ with no value to give it.
+	bool IsWaiting(int a_session) const { return m_sessions[a_session]->state == ImageInstance::RUN_WAITING; }
+
+	// Takes the output a session has sent since it was last taken.
+	string TakeOutput(int a_session) { return m_sessions[a_session]->device.TakeOutput(); }
+
+	// Describes the error that stopped a session, if any.
+	const string &GetError(int a_session) const
+	{
+		const Session &session = *m_sessions[a_session];
+		return session.error.empty() ? session.instance.GetError() : session.error;
+	}
+
+	// The number of turns run, of turns that used up their fuel, and of turns that ended at a READ.
+	long long GetTurns() const { return m_turns; }
+	long long GetPreemptions() const { return m_preemptions; }
+	long long GetWaits() const { return m_waits; }
+
+private:
+
+	// One run of the program, with the values it has been given and the output it has sent.
+	struct Session {
+		Session(shared_ptr<const SharedImage> a_image) : instance(a_image) {}
+		ImageInstance instance;		// The program's memory and where it is up to.
+		QueueDevice device;			// The values waiting for READ, and the output.
+		ImageInstance::RunState state = ImageInstance::RUN_PREEMPTED;	// How the last turn ended.
+		bool queued = false;		// == true if the session is waiting for a turn.
+		long long busy = 0;			// The instructions run since the session last waited for input.
+		string error;				// Why the scheduler stopped the session, if it did.
+	};
+
+	shared_ptr<const SharedImage> m_image;	// The program every session runs.
+	long long m_fuel;						// The most instructions a session runs in one turn.
+	long long m_sessionFuel;				// The most it runs without waiting for input, or 0 for no limit.
+	vector<unique_ptr<Session>> m_sessions;	// The sessions, by number.
+	deque<int> m_ready;						// The sessions waiting for a turn, in order.
+	long long m_turns = 0;					// The turns run.
+	long long m_preemptions = 0;			// The turns that used up their fuel.
+	long long m_waits = 0;					// The turns that ended at a READ with no value.
+
+	// Puts a session that was waiting for input back in line for a turn.
+	void Wake(int a_session);
+};
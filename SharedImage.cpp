@@ -0,0 +1,261 @@
+//
+//		Implementation of the SharedImage and ImageInstance classes.
+//
+#include "stdafx.h"
+#include "SharedImage.h"
+#include "ImageVerifier.h"
+#include <limits>
+
+/*
+SharedImage::SharedImage()
+
+NAME
+
+SharedImage::SharedImage - copies a loaded program into an image that instances can share
+
+SYNOPSIS
+
+SharedImage::SharedImage(const Emulator &a_emul);
+	a_emul -> the emulator holding the loaded program
+
+DESCRIPTION
+
+This function copies the emulator's memory and decodes it, along with the next instruction
+table the engines use to skip over data. The ImageVerifier works out which words the program
+can step onto and which words its STOREs and READs can write. While the program's instructions
+are unchanged, those are the only words an instance ever writes, so each one is given a slot
+in the instances' overlays. None of this changes after construction, so one image can be used
+by any number of instances at once, on any number of threads.
+*/
+SharedImage::SharedImage(const Emulator &a_emul)
+	: m_memory(Emulator::MEMSZ), m_decoded(Emulator::MEMSZ + 1), m_nextInstruction(Emulator::MEMSZ + 1),
+	m_slot(Emulator::MEMSZ, -1), m_runnable(Emulator::MEMSZ, false)
+{
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		m_memory[loc] = a_emul.GetMemory(loc);
+		Emulator::SplitWord(m_memory[loc], m_decoded[loc].opCode, m_decoded[loc].address);
+		m_decoded[loc].dispatch = m_decoded[loc].opCode;
+	}
+	m_decoded[Emulator::MEMSZ].opCode = Emulator::OP_END;
+	m_decoded[Emulator::MEMSZ].dispatch = Emulator::OP_END;
+
+	int next = Emulator::MEMSZ;
+	m_nextInstruction[Emulator::MEMSZ] = next;
+	for (int loc = Emulator::MEMSZ - 1; loc >= 0; loc--)
+	{
+		if (m_decoded[loc].opCode != 0)
+		{
+			next = loc;
+		}
+		m_nextInstruction[loc] = next;
+	}
+
+	ImageVerifier verifier(a_emul);
+	verifier.Verify();
+	m_writtenWords = verifier.GetWrittenWords();
+	for (int slot = 0; slot < (int)m_writtenWords.size(); slot++)
+	{
+		m_slot[m_writtenWords[slot]] = slot;
+	}
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		m_runnable[loc] = verifier.IsWalked(loc);
+	}
+}
+
+// Sets up the overlay to hold the words the program writes, as they were loaded.
+ImageInstance::ImageInstance(shared_ptr<const SharedImage> a_image)
+	: m_image(a_image)
+{
+	Reset();
+}
+
+// Throws away the copy of memory, if any, and puts the loaded words back into the overlay.
+void ImageInstance::Reset()
+{
+	vector<Emulator::Word>().swap(m_private);
+	const vector<int> &written = m_image->GetWrittenWords();
+	m_words.resize(written.size());
+	for (size_t slot = 0; slot < written.size(); slot++)
+	{
+		m_words[slot] = m_image->GetMemory(written[slot]);
+	}
+	Restart();
+}
+
+// Goes back to the start of the program, with a cleared accumulator, leaving memory as it is.
+void ImageInstance::Restart()
+{
+	m_accumulator = 0;
+	m_address = 0;
+	m_error.clear();
+}
+
+// Copies the image into a memory of this instance's own, with its writes on top. From then on
+// the instance decodes each word as it runs, since its code no longer matches the image.
+void ImageInstance::MakePrivate()
+{
+	m_private.resize(Emulator::MEMSZ);
+	for (int loc = 0; loc < Emulator::MEMSZ; loc++)
+	{
+		m_private[loc] = m_image->GetMemory(loc);
+	}
+	const vector<int> &written = m_image->GetWrittenWords();
+	for (size_t slot = 0; slot < written.size(); slot++)
+	{
+		m_private[written[slot]] = m_words[slot];
+	}
+}
+
+// Runs the program from the start to the end, on a device that is always ready to READ.
+bool ImageInstance::Run(IODevice &a_io)
+{
+	Restart();
+	return RunSlice(a_io, 0) == RUN_DONE;
+}
+
+/*
+ImageInstance::RunSlice()
+
+NAME
+
+ImageInstance::RunSlice - runs the shared program on from where it last stopped
+
+SYNOPSIS
+
+ImageInstance::RunState ImageInstance::RunSlice(IODevice &a_io, long long a_fuel, BranchCoverage *a_coverage);
+	a_io -> where READ and WRITE get and send values
+	a_fuel -> the most instructions to run before handing control back, or 0 for no limit
+	a_coverage -> counts each way each branch goes, or NULL
+
+DESCRIPTION
+
+This function runs the program the same way Emulator::PerformAction does, carrying on from the
+location and accumulator the last slice stopped at, with the memory as the instance last left
+it. Restart, or Reset as well to go back to the loaded image, before the first slice. The
+program is set aside, to be carried on by the next slice, when it reaches a READ that its device
+is not ready for, or when it has used up its fuel. That is what lets one thread take turns
+running many programs, none of which can hold on to the thread for long. When the program stops
+with an error, the location and accumulator are kept for GetAddress.
+
+While the program's instructions are unchanged, words are read from the overlay if the program
+writes them, and from the shared image otherwise, and the shared decoded memory and next
+instruction table are used to step through the program. Once a write could change an
+instruction, the instance copies all of memory and decodes each word as it reaches it. Errors
+are kept in the instance rather than recorded with Errors, so that instances can run on several
+threads.
+
+RETURNS
+
+Returns RUN_DONE if the program ran to the end, and RUN_FAILED if an error stopped it. The device
+is flushed in either case. Returns RUN_WAITING if it stopped at a READ with no value ready, and
+RUN_PREEMPTED if it used up its fuel.
+*/
+ImageInstance::RunState ImageInstance::RunSlice(IODevice &a_io, long long a_fuel, BranchCoverage *a_coverage)
+{
+	Emulator::Word accumulator = m_accumulator;
+	int address = m_address;
+	long long fuel = (a_fuel == 0) ? numeric_limits<long long>::max() : a_fuel;
+
+	for (;;)
+	{
+		int opCode, operand;
+		if (m_private.empty())
+		{
+			address = m_image->NextInstruction(address);
+			opCode = m_image->GetDecoded(address).opCode;
+			operand = m_image->GetDecoded(address).address;
+		}
+		else
+		{
+			Emulator::SplitWord((address < Emulator::MEMSZ) ? m_private[address] : 0, opCode, operand);
+			if (opCode == 0 && address < Emulator::MEMSZ)
+			{
+				address++;
+				continue;
+			}
+		}
+		if (address >= Emulator::MEMSZ)
+		{
+			break;
+		}
+
+		// Set the program aside at this instruction if it cannot run it now.
+		if (fuel-- == 0 || (opCode == Emulator::OP_READ && !a_io.IsReadReady()))
+		{
+			m_accumulator = accumulator;
+			m_address = address;
+			return (fuel < 0) ? RUN_PREEMPTED : RUN_WAITING;
+		}
+
+		switch (opCode)
+		{
+		case Emulator::OP_ADD:
+			accumulator = Emulator::Calculate(Emulator::OP_ADD, accumulator, ReadWord(operand));
+			break;
+		case Emulator::OP_SUB:
+			accumulator = Emulator::Calculate(Emulator::OP_SUB, accumulator, ReadWord(operand));
+			break;
+		case Emulator::OP_MULT:
+			accumulator = Emulator::Calculate(Emulator::OP_MULT, accumulator, ReadWord(operand));
+			break;
+		case Emulator::OP_DIV:
+			if (!Emulator::CanDivide(ReadWord(operand)))
+			{
+				m_error = Emulator::DIVIDE_BY_ZERO_ERROR;
+				m_accumulator = accumulator;
+				m_address = address;
+				a_io.Flush();
+				return RUN_FAILED;
+			}
+			accumulator = Emulator::Calculate(Emulator::OP_DIV, accumulator, ReadWord(operand));
+			break;
+		case Emulator::OP_LOAD:
+			accumulator = ReadWord(operand);
+			break;
+		case Emulator::OP_STORE:
+			if (!Emulator::CanStore(accumulator))
+			{
+				m_error = Emulator::STORE_TOO_BIG_ERROR;
+				m_accumulator = accumulator;
+				m_address = address;
+				a_io.Flush();
+				return RUN_FAILED;
+			}
+			WriteWord(operand, accumulator);
+			break;
+		case Emulator::OP_READ:
+			WriteWord(operand, (Emulator::Word)a_io.Read());
+			break;
+		case Emulator::OP_WRITE:
+			a_io.Write(ReadWord(operand));
+			break;
+		case Emulator::OP_B:
+		case Emulator::OP_BM:
+		case Emulator::OP_BZ:
+		case Emulator::OP_BP:
+		{
+			bool taken = Emulator::BranchTaken(opCode, accumulator);
+			if (a_coverage != NULL)
+			{
+				a_coverage->Hit(address, taken);
+			}
+			if (taken)
+			{
+				address = operand - 1;
+			}
+			break;
+		}
+		case Emulator::OP_HALT:
+			address = Emulator::MEMSZ - 1;
+			break;
+		}
+		address++;
+	}
+
+	m_accumulator = accumulator;
+	m_address = Emulator::MEMSZ;
+	a_io.Flush();
+	return RUN_DONE;
+}
@@ -0,0 +1,152 @@
+//
+//		SharedImage and ImageInstance classes - many runs of one loaded program that share its memory.
+//
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Emulator.h"
+
+// A loaded program, decoded once and never changed, that any number of ImageInstances can run.
+class SharedImage {
+
+public:
+
+	// Copies and decodes the program in the emulator's memory.
+	SharedImage(const Emulator &a_emul);
+
+	// Gets the contents of a word as it was loaded.
+	Emulator::Word GetMemory(int a_location) const { return m_memory[a_location]; }
+
+	// Gets the decoded word at a location. The word past the end of memory is OP_END.
+	const Emulator::DecodedWord &GetDecoded(int a_location) const { return m_decoded[a_location]; }
+
+	// Finds the first instruction at or after a location, or MEMSZ if there is none.
+	int NextInstruction(int a_location) const { return m_nextInstruction[a_location]; }
+
+	// The words the program can write while its instructions are unchanged, in slot order.
+	const vector<int> &GetWrittenWords() const { return m_writtenWords; }
+
+	// Gets the slot of a word in an instance's overlay, or -1 if the program never writes it.
+	int GetSlot(int a_location) const { return m_slot[a_location]; }
+
+	// Determines if writing to a word can change what the program runs.
+	bool IsRunnable(int a_location) const { return m_runnable[a_location]; }
+
+private:
+
+	vector<Emulator::Word> m_memory;				// The memory as it was loaded.
+	vector<Emulator::DecodedWord> m_decoded;		// The memory, decoded.
+	vector<int> m_nextInstruction;					// The first instruction at or after each location.
+	vector<int> m_writtenWords;						// The words the program can write.
+	vector<int> m_slot;								// Each word's index in m_writtenWords, or -1.
+	vector<bool> m_runnable;						// == true if the emulator could step onto the word.
+};
+
+// Counts how often each branch of a run was taken and not taken, for a fuzzer's coverage.
+struct BranchCoverage {
+
+	// Allocates a count for each way each word of memory could branch.
+	BranchCoverage() : counts(2 * Emulator::MEMSZ, 0) {}
+
+	// Counts one branch at a location. Counts stop at 255.
+	void Hit(int a_location, bool a_taken)
+	{
+		int edge = 2 * a_location + (a_taken ? 1 : 0);
+		if (counts[edge] == 0)
+		{
+			touched.push_back(edge);
+		}
+		if (counts[edge] != 255)
+		{
+			counts[edge]++;
+		}
+	}
+
+	// Clears the counts of the branches in the last run.
+	void Clear()
+	{
+		for (size_t i = 0; i < touched.size(); i++)
+		{
+			counts[touched[i]] = 0;
+		}
+		touched.clear();
+	}
+
+	vector<unsigned char> counts;	// The count for each location and way, at 2 * location + taken.
+	vector<int> touched;			// The counts that are not 0.
+};
+
+// One run of a SharedImage. Only the words the program writes are held by the instance.
+class ImageInstance {
+
+public:
+
+	// Why RunSlice handed control back.
+	enum RunState {
+		RUN_DONE,		// The program ran to the end.
+		RUN_FAILED,		// An error stopped the program.
+		RUN_WAITING,	// The program is at a READ that its device has no value for yet.
+		RUN_PREEMPTED	// The program used up the instructions it was given.
+	};
+
+	// Prepares to run the image.
+	ImageInstance(shared_ptr<const SharedImage> a_image);
+
+	// Runs the program from the start, with READ and WRITE going through the device.
+	bool Run(IODevice &a_io);
+
+	// Runs the program on from where it stopped, for at most a_fuel instructions (0 for no limit).
+	RunState RunSlice(IODevice &a_io, long long a_fuel, BranchCoverage *a_coverage = NULL);
+
+	// Goes back to the image as it was loaded, and to the start of the program.
+	void Reset();
+
+	// Goes back to the start of the program, without changing memory.
+	void Restart();
+
+	// Describes the error that stopped the last run, if any.
+	const string &GetError() const { return m_error; }
+
+	// Gets the location the program carries on from, or stopped at with an error.
+	int GetAddress() const { return m_address; }
+
+private:
+
+	shared_ptr<const SharedImage> m_image;	// The program being run.
+	vector<Emulator::Word> m_words;			// The words the program writes, one per slot.
+	vector<Emulator::Word> m_private;		// All of memory, once the program has changed its own code.
+	string m_error;							// Why the last run stopped early.
+	Emulator::Word m_accumulator;			// The accumulator, while the program is set aside.
+	int m_address;							// Where the program carries on from.
+
+	// Gets the current contents of a word.
+	Emulator::Word ReadWord(int a_location) const
+	{
+		if (!m_private.empty())
+		{
+			return m_private[a_location];
+		}
+		int slot = m_image->GetSlot(a_location);
+		return (slot < 0) ? m_image->GetMemory(a_location) : m_words[slot];
+	}
+
+	// Writes a word, taking a copy of all of memory first if the write could change the program.
+	void WriteWord(int a_location, Emulator::Word a_contents)
+	{
+		if (m_private.empty())
+		{
+			int slot = m_image->GetSlot(a_location);
+			if (slot >= 0 && !m_image->IsRunnable(a_location))
+			{
+				m_words[slot] = a_contents;
+				return;
+			}
+			MakePrivate();
+		}
+		m_private[a_location] = a_contents;
+	}
+
+	// Copies the image and this instance's writes into a memory of its own.
+	void MakePrivate();
+};
@@ -0,0 +1,717 @@
+//
+//		Implementation of the Superoptimizer class.
+//
+#include "stdafx.h"
+#include "Superoptimizer.h"
+#include <algorithm>
+#include <thread>
+#include <type_traits>
+
+typedef Emulator::Word Word;
+
+// Values at the edges of what the arithmetic does: zero, one, the largest word that can be stored,
+// just past it, and the limits of the word type.
+static const Word s_edges[] = {
+	0, 1, -1, Emulator::MAX_WORD - 1, Emulator::MAX_WORD, (Word)(Emulator::MAX_WORD + 1LL),
+	-Emulator::MAX_WORD, numeric_limits<Word>::max(), numeric_limits<Word>::min()
+};
+static const int EDGE_COUNT = sizeof(s_edges) / sizeof(s_edges[0]);
+
+// Picks a value for a test: mostly small ones and ones a word is meant to hold, with some at the
+// edges and some anywhere in the word type.
+static Word RandomValue(mt19937_64 &a_random)
+{
+	const long long maxWord = Emulator::MAX_WORD;
+	switch (a_random() % 8)
+	{
+	case 0:
+	case 1:
+	case 2:
+		return (Word)((long long)(a_random() % 201) - 100);
+	case 3:
+	case 4:
+		return (Word)((long long)(a_random() % (2 * maxWord + 1)) - maxWord);
+	case 5:
+		return (Word)a_random();
+	default:
+		return s_edges[a_random() % EDGE_COUNT];
+	}
+}
+
+/*
+Superoptimizer::Superoptimizer()
+
+NAME
+
+Superoptimizer::Superoptimizer - prepares to search a loaded program
+
+SYNOPSIS
+
+Superoptimizer::Superoptimizer(const Emulator &a_emul, int a_maxLength, int a_threads);
+	a_emul -> the emulator the program is loaded into
+	a_maxLength -> the longest sequence of the program to search for a shorter one
+	a_threads -> the threads the search runs on
+
+DESCRIPTION
+
+This function goes through every word of memory that decodes as an instruction, and notes the
+words that STORE and READ can write, the words operands name and the words branches go to. A
+word that nothing writes holds a constant, which candidates may use. A word that an operand
+names, or that a branch can go to from outside, cannot be part of a sequence that is replaced.
+*/
+Superoptimizer::Superoptimizer(const Emulator &a_emul, int a_maxLength, int a_threads) :
+	m_emul(a_emul), m_maxLength(a_maxLength), m_threads(max(1, a_threads)),
+	m_written(Emulator::MEMSZ, 0), m_operand(Emulator::MEMSZ, 0), m_branchTarget(Emulator::MEMSZ, 0)
+{
+	for (int location = 0; location < Emulator::MEMSZ; location++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(location), opCode, address);
+		if (opCode == Emulator::OP_DATA || address >= Emulator::MEMSZ)
+		{
+			continue;
+		}
+		if (opCode >= Emulator::OP_B && opCode <= Emulator::OP_BP)
+		{
+			m_branchTarget[address] = 1;
+		}
+		else if (opCode != Emulator::OP_HALT)
+		{
+			m_operand[address] = 1;
+		}
+		if (opCode == Emulator::OP_STORE || opCode == Emulator::OP_READ)
+		{
+			m_written[address] = 1;
+		}
+	}
+}
+
+/*
+Superoptimizer::Run()
+
+NAME
+
+Superoptimizer::Run - searches the hottest straight-line code for shorter sequences
+
+SYNOPSIS
+
+bool Superoptimizer::Run(const Profiler &a_profile, int a_blocks);
+	a_profile -> how often each word of the program was run, or empty if unknown
+	a_blocks -> the number of blocks to search
+
+DESCRIPTION
+
+This function splits the program into blocks: runs of ADD, SUB, MULT, DIV, LOAD and STORE that
+are only entered at the top. The instructions that READ, WRITE, branch or halt are left as they
+are, since nothing without them does what they do. The blocks that ran most often are searched,
+or every block if there is no profile. In each block, starting from the top, the longest
+sequence that has a shorter equivalent is replaced, and the search goes on after it; where none
+of the sequences starting at an instruction has one, it goes on from the next instruction.
+
+RETURNS
+
+Returns false if the program can write to its own code, in which case nothing is searched.
+*/
+bool Superoptimizer::Run(const Profiler &a_profile, int a_blocks)
+{
+	for (int location = 0; location < Emulator::MEMSZ; location++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(location), opCode, address);
+		if (m_written[location] && (opCode != Emulator::OP_DATA || a_profile.GetExecutions(location) > 0))
+		{
+			return false;
+		}
+	}
+
+	// A word can be replaced if it is one of the instructions searched, and nothing reads or writes it.
+	auto replaceable = [this](int a_location, Step &a_step)
+	{
+		Emulator::SplitWord(m_emul.GetMemory(a_location), a_step.opCode, a_step.address);
+		return a_step.opCode >= Emulator::OP_ADD && a_step.opCode <= Emulator::OP_STORE &&
+			a_step.address < Emulator::MEMSZ && !m_written[a_location] && !m_operand[a_location];
+	};
+
+	struct Block {
+		int start;
+		vector<Step> steps;
+		long long executions;
+	};
+	vector<Block> blocks;
+	Step step;
+	for (int location = 0; location < Emulator::MEMSZ; location++)
+	{
+		if (!replaceable(location, step))
+		{
+			continue;
+		}
+		Block block = { location, vector<Step>(1, step), a_profile.GetExecutions(location) };
+		while (location + 1 < Emulator::MEMSZ && !m_branchTarget[location + 1] && replaceable(location + 1, step))
+		{
+			block.steps.push_back(step);
+			location++;
+		}
+		if (block.steps.size() >= 2 && (a_profile.IsEmpty() || block.executions > 0))
+		{
+			blocks.push_back(block);
+		}
+	}
+	stable_sort(blocks.begin(), blocks.end(), [](const Block &a_first, const Block &a_second)
+	{
+		return a_first.executions > a_second.executions;
+	});
+	if ((int)blocks.size() > a_blocks)
+	{
+		blocks.resize(a_blocks);
+	}
+
+	for (size_t block = 0; block < blocks.size(); block++)
+	{
+		const vector<Step> &steps = blocks[block].steps;
+		size_t start = 0;
+		while (start + 1 < steps.size())
+		{
+			size_t length = min((size_t)m_maxLength, steps.size() - start);
+			for (; length >= 2; length--)
+			{
+				Finding finding;
+				vector<Step> target(steps.begin() + start, steps.begin() + start + length);
+				if (Search(blocks[block].start + (int)start, target, finding))
+				{
+					finding.executions = a_profile.GetExecutions(finding.location);
+					m_findings.push_back(finding);
+					break;
+				}
+			}
+			start += length;
+		}
+	}
+	return true;
+}
+
+/*
+Superoptimizer::Search()
+
+NAME
+
+Superoptimizer::Search - searches for the shortest sequence that does what a sequence does
+
+SYNOPSIS
+
+bool Superoptimizer::Search(int a_location, const vector<Step> &a_target, Finding &a_finding);
+	a_location -> where the sequence starts
+	a_target -> the sequence
+	a_finding -> what was found, if anything
+
+DESCRIPTION
+
+This function tries the candidates one length at a time, from none at all to one less than the
+sequence, so the first found is a shortest one. The threads split each length's candidates by
+their first instruction. A candidate is run on the first cheap test as it is built up, one
+instruction at a time, so most are thrown out after a few steps; one that gets through every
+cheap test is then checked fully. Of the candidates that pass, the first in the order of the
+alphabet is kept, so the result does not depend on how the threads happened to run.
+
+RETURNS
+
+Returns true if a shorter sequence was found.
+*/
+bool Superoptimizer::Search(int a_location, const vector<Step> &a_target, Finding &a_finding)
+{
+	Problem problem;
+	if (!MakeProblem(a_location, a_target, problem))
+	{
+		return false;
+	}
+	m_targets++;
+
+	for (int length = 0; length < (int)a_target.size(); length++)
+	{
+		LengthSearch search;
+		search.problem = &problem;
+		search.length = length;
+		search.bestFirst = (int)problem.alphabet.size();
+		if (length == 0)
+		{
+			// The empty candidate has no first instruction to split on.
+			State state;
+			StartState(problem, problem.tests[0], state);
+			long long tried = 0;
+			if (Extend(problem, search.best, 0, state, tried, search.checked))
+			{
+				search.bestFirst = 0;
+			}
+			search.tried = tried;
+		}
+		else
+		{
+			vector<thread> workers;
+			for (int worker = 1; worker < m_threads; worker++)
+			{
+				workers.push_back(thread(&Superoptimizer::Worker, this, &search));
+			}
+			Worker(&search);
+			for (size_t worker = 0; worker < workers.size(); worker++)
+			{
+				workers[worker].join();
+			}
+		}
+		m_candidates += search.tried;
+
+		if (search.bestFirst < (int)problem.alphabet.size())
+		{
+			a_finding.location = a_location;
+			a_finding.target = a_target;
+			a_finding.replacement.clear();
+			for (size_t i = 0; i < search.best.size(); i++)
+			{
+				const SlotStep &step = problem.alphabet[search.best[i]];
+				a_finding.replacement.push_back({ step.opCode, problem.addresses[step.slot] });
+			}
+			a_finding.vectorsChecked = search.checked;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Takes first instructions until there are none left, or none that could come before the best
+// candidate found so far.
+void Superoptimizer::Worker(LengthSearch *a_search)
+{
+	const Problem &problem = *a_search->problem;
+	vector<int> candidate(a_search->length);
+	long long tried = 0;
+	for (;;)
+	{
+		int first = a_search->nextFirst++;
+		if (first >= (int)problem.alphabet.size())
+		{
+			break;
+		}
+		{
+			lock_guard<mutex> lock(a_search->lock);
+			if (first > a_search->bestFirst)
+			{
+				break;
+			}
+		}
+		if (Redundant(problem, -1, first))
+		{
+			continue;
+		}
+		State state;
+		StartState(problem, problem.tests[0], state);
+		Execute(problem.alphabet[first], state);
+		candidate[0] = first;
+		long long checked = 0;
+		if (Extend(problem, candidate, 1, state, tried, checked))
+		{
+			lock_guard<mutex> lock(a_search->lock);
+			if (first < a_search->bestFirst)
+			{
+				a_search->bestFirst = first;
+				a_search->best = candidate;
+				a_search->checked = checked;
+			}
+		}
+	}
+	a_search->tried += tried;
+}
+
+bool Superoptimizer::Extend(const Problem &a_problem, vector<int> &a_candidate, int a_depth, const State &a_state,
+	long long &a_tried, long long &a_checked)
+{
+	if (a_depth == (int)a_candidate.size())
+	{
+		a_tried++;
+		if (!SameResult(a_problem, a_state, a_problem.expected[0]))
+		{
+			return false;
+		}
+		vector<SlotStep> sequence;
+		for (size_t i = 0; i < a_candidate.size(); i++)
+		{
+			sequence.push_back(a_problem.alphabet[a_candidate[i]]);
+		}
+		State state;
+		for (size_t test = 1; test < a_problem.tests.size(); test++)
+		{
+			RunSequence(a_problem, sequence, a_problem.tests[test], state);
+			if (!SameResult(a_problem, state, a_problem.expected[test]))
+			{
+				return false;
+			}
+		}
+		a_checked = CheckFully(a_problem, sequence);
+		return a_checked != 0;
+	}
+
+	int previous = (a_depth > 0) ? a_candidate[a_depth - 1] : -1;
+	for (int step = 0; step < (int)a_problem.alphabet.size(); step++)
+	{
+		if (Redundant(a_problem, previous, step))
+		{
+			continue;
+		}
+		State state = a_state;
+		if (state.outcome == RAN)
+		{
+			Execute(a_problem.alphabet[step], state);
+		}
+		a_candidate[a_depth] = step;
+		if (Extend(a_problem, a_candidate, a_depth + 1, state, a_tried, a_checked))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// A candidate that does not use the accumulator it starts with loads it first. A LOAD straight
+// after a LOAD, or after a STORE into the same word, changes nothing that a shorter candidate
+// would not; nor does storing into the same word twice.
+bool Superoptimizer::Redundant(const Problem &a_problem, int a_previous, int a_step)
+{
+	const SlotStep &step = a_problem.alphabet[a_step];
+	if (a_previous < 0)
+	{
+		return !a_problem.accumulatorIn && step.opCode != Emulator::OP_LOAD;
+	}
+	const SlotStep &previous = a_problem.alphabet[a_previous];
+	if (step.opCode == Emulator::OP_LOAD)
+	{
+		return previous.opCode == Emulator::OP_LOAD || (previous.opCode == Emulator::OP_STORE && previous.slot == step.slot);
+	}
+	return step.opCode == Emulator::OP_STORE && previous.opCode == Emulator::OP_STORE && previous.slot == step.slot;
+}
+
+/*
+Superoptimizer::MakeProblem()
+
+NAME
+
+Superoptimizer::MakeProblem - works out what a sequence reads, writes and leaves behind
+
+SYNOPSIS
+
+bool Superoptimizer::MakeProblem(int a_location, const vector<Step> &a_target, Problem &a_problem) const;
+	a_location -> where the sequence starts
+	a_target -> the sequence
+	a_problem -> the search to set up
+
+DESCRIPTION
+
+This function gives each word the sequence names a slot. A word the program can write is an
+input, which the tests set; a word nothing writes is a constant. The constants of the rest of
+the program are added, one for each value, so that a candidate may use a constant the sequence
+does not. The accumulator is an input if the sequence uses it before loading it, and an output
+unless the next instruction loads it. The words the sequence stores into are outputs, and are
+the only words a candidate may store into.
+
+The alphabet of the candidates is every LOAD, ADD, SUB, MULT and DIV of a slot, and every STORE
+into an output. The cheap tests start with random values, followed by the same value in every
+input for each of the edge values, and more random values, with what the sequence does on each.
+
+RETURNS
+
+Returns false if the sequence names too many words to search.
+*/
+bool Superoptimizer::MakeProblem(int a_location, const vector<Step> &a_target, Problem &a_problem) const
+{
+	Problem &problem = a_problem;
+	for (size_t i = 0; i < a_target.size(); i++)
+	{
+		int address = a_target[i].address;
+		if (m_written[address] && find(problem.addresses.begin(), problem.addresses.end(), address) == problem.addresses.end())
+		{
+			problem.addresses.push_back(address);
+		}
+	}
+	problem.inputs = (int)problem.addresses.size();
+	if (problem.inputs + MAX_CONSTANTS > MAX_SLOTS)
+	{
+		return false;
+	}
+
+	// A constant takes the slot of an earlier one with the same value.
+	auto constantSlot = [&](int a_address)
+	{
+		Word value = m_emul.GetMemory(a_address);
+		for (size_t constant = 0; constant < problem.constants.size(); constant++)
+		{
+			if (problem.constants[constant] == value)
+			{
+				return problem.inputs + (int)constant;
+			}
+		}
+		if (problem.constants.size() == MAX_CONSTANTS)
+		{
+			return -1;
+		}
+		problem.constants.push_back(value);
+		problem.addresses.push_back(a_address);
+		return problem.inputs + (int)problem.constants.size() - 1;
+	};
+	for (size_t i = 0; i < a_target.size(); i++)
+	{
+		const Step &step = a_target[i];
+		int slot;
+		if (m_written[step.address])
+		{
+			slot = (int)(find(problem.addresses.begin(), problem.addresses.end(), step.address) - problem.addresses.begin());
+		}
+		else
+		{
+			slot = constantSlot(step.address);
+		}
+		problem.target.push_back({ step.opCode, slot });
+		if (step.opCode == Emulator::OP_STORE && find(problem.stored.begin(), problem.stored.end(), slot) == problem.stored.end())
+		{
+			problem.stored.push_back(slot);
+		}
+	}
+	for (int location = 0; location < Emulator::MEMSZ; location++)
+	{
+		if (m_operand[location] && !m_written[location])
+		{
+			constantSlot(location);
+		}
+	}
+	problem.slots = problem.inputs + (int)problem.constants.size();
+
+	problem.accumulatorIn = (problem.target[0].opCode != Emulator::OP_LOAD);
+	problem.accumulatorOut = true;
+	for (int location = a_location + (int)a_target.size(); location < Emulator::MEMSZ; location++)
+	{
+		int opCode, address;
+		Emulator::SplitWord(m_emul.GetMemory(location), opCode, address);
+		if (opCode != Emulator::OP_DATA)
+		{
+			problem.accumulatorOut = (opCode != Emulator::OP_LOAD);
+			break;
+		}
+	}
+
+	const int opCodes[] = { Emulator::OP_LOAD, Emulator::OP_ADD, Emulator::OP_SUB, Emulator::OP_MULT, Emulator::OP_DIV };
+	for (int opCode : opCodes)
+	{
+		for (int slot = 0; slot < problem.slots; slot++)
+		{
+			problem.alphabet.push_back({ opCode, slot });
+		}
+	}
+	for (size_t i = 0; i < problem.stored.size(); i++)
+	{
+		problem.alphabet.push_back({ Emulator::OP_STORE, problem.stored[i] });
+	}
+
+	mt19937_64 random(a_location);
+	problem.tests.resize(CHEAP_TESTS);
+	for (int test = 0; test < CHEAP_TESTS; test++)
+	{
+		TestVector &values = problem.tests[test];
+		if (test >= 1 && test <= EDGE_COUNT)
+		{
+			values.accumulator = s_edges[test - 1];
+			fill(values.inputs, values.inputs + MAX_SLOTS, s_edges[test - 1]);
+		}
+		else
+		{
+			RandomTest(problem, random, values);
+		}
+	}
+	problem.expected.resize(CHEAP_TESTS);
+	for (int test = 0; test < CHEAP_TESTS; test++)
+	{
+		RunSequence(problem, problem.target, problem.tests[test], problem.expected[test]);
+	}
+	return true;
+}
+
+// Runs one instruction with the same helpers as the emulator's engines.
+void Superoptimizer::Execute(const SlotStep &a_step, State &a_state)
+{
+	Word &accumulator = a_state.accumulator;
+	Word operand = a_state.slots[a_step.slot];
+	switch (a_step.opCode)
+	{
+	case Emulator::OP_ADD:
+	case Emulator::OP_SUB:
+	case Emulator::OP_MULT:
+	case Emulator::OP_LOAD:
+		accumulator = Emulator::Calculate(a_step.opCode, accumulator, operand);
+		break;
+	case Emulator::OP_DIV:
+		if (!Emulator::CanDivide(operand))
+		{
+			a_state.outcome = DIVIDE_BY_ZERO;
+		}
+		else
+		{
+			accumulator = Emulator::Calculate(Emulator::OP_DIV, accumulator, operand);
+		}
+		break;
+	case Emulator::OP_STORE:
+		if (!Emulator::CanStore(accumulator))
+		{
+			a_state.outcome = STORE_TOO_BIG;
+		}
+		else
+		{
+			a_state.slots[a_step.slot] = accumulator;
+		}
+		break;
+	}
+}
+
+void Superoptimizer::StartState(const Problem &a_problem, const TestVector &a_test, State &a_state)
+{
+	a_state.accumulator = a_test.accumulator;
+	a_state.outcome = RAN;
+	copy(a_test.inputs, a_test.inputs + a_problem.inputs, a_state.slots);
+	copy(a_problem.constants.begin(), a_problem.constants.end(), a_state.slots + a_problem.inputs);
+}
+
+// Runs that stopped with the same error stop the program the same way, whatever they had done.
+bool Superoptimizer::SameResult(const Problem &a_problem, const State &a_first, const State &a_second)
+{
+	if (a_first.outcome != a_second.outcome)
+	{
+		return false;
+	}
+	if (a_first.outcome != RAN)
+	{
+		return true;
+	}
+	if (a_problem.accumulatorOut && a_first.accumulator != a_second.accumulator)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < a_problem.stored.size(); i++)
+	{
+		if (a_first.slots[a_problem.stored[i]] != a_second.slots[a_problem.stored[i]])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void Superoptimizer::RunSequence(const Problem &a_problem, const vector<SlotStep> &a_sequence, const TestVector &a_test, State &a_state)
+{
+	StartState(a_problem, a_test, a_state);
+	for (size_t i = 0; i < a_sequence.size() && a_state.outcome == RAN; i++)
+	{
+		Execute(a_sequence[i], a_state);
+	}
+}
+
+void Superoptimizer::RandomTest(const Problem &a_problem, mt19937_64 &a_random, TestVector &a_test)
+{
+	a_test.accumulator = RandomValue(a_random);
+	for (int input = 0; input < a_problem.inputs; input++)
+	{
+		a_test.inputs[input] = RandomValue(a_random);
+	}
+}
+
+/*
+Superoptimizer::CheckFully()
+
+NAME
+
+Superoptimizer::CheckFully - checks a candidate against the sequence on many more inputs
+
+SYNOPSIS
+
+long long Superoptimizer::CheckFully(const Problem &a_problem, const vector<SlotStep> &a_candidate);
+	a_problem -> the sequence and what it reads and writes
+	a_candidate -> a candidate that passed the cheap tests
+
+DESCRIPTION
+
+This function runs the candidate and the sequence on every combination of the values that
+matter most, for the inputs and the accumulator if the sequence uses it: every value from -R to
+R, and the edge values. R is as large as it can be without going over CHECK_BUDGET combinations;
+if even R = 1 would, the combinations are left out. Then it runs both on RANDOM_CHECKS random
+tests.
+
+RETURNS
+
+Returns the number of tests run, or 0 if the candidate did something different on one of them.
+*/
+long long Superoptimizer::CheckFully(const Problem &a_problem, const vector<SlotStep> &a_candidate)
+{
+	int inputs = a_problem.inputs + (a_problem.accumulatorIn ? 1 : 0);
+	auto combinations = [inputs](long long a_values)
+	{
+		long long count = 1;
+		for (int input = 0; input < inputs && count <= CHECK_BUDGET; input++)
+		{
+			count *= a_values;
+		}
+		return count;
+	};
+	int range = 0;
+	while (combinations(2 * (range + 1) + 1 + EDGE_COUNT) <= CHECK_BUDGET && range < 1000)
+	{
+		range++;
+	}
+
+	long long tests = 0;
+	State expected, actual;
+	TestVector test = {};
+	auto check = [&]()
+	{
+		tests++;
+		RunSequence(a_problem, a_problem.target, test, expected);
+		RunSequence(a_problem, a_candidate, test, actual);
+		return SameResult(a_problem, expected, actual);
+	};
+
+	if (range > 0)
+	{
+		vector<Word> values;
+		for (int value = -range; value <= range; value++)
+		{
+			values.push_back(value);
+		}
+		values.insert(values.end(), s_edges, s_edges + EDGE_COUNT);
+
+		// Count through every combination, the last input being the accumulator if it is one.
+		vector<size_t> digits(inputs, 0);
+		for (;;)
+		{
+			for (int input = 0; input < a_problem.inputs; input++)
+			{
+				test.inputs[input] = values[digits[input]];
+			}
+			test.accumulator = a_problem.accumulatorIn ? values[digits[inputs - 1]] : 0;
+			if (!check())
+			{
+				return 0;
+			}
+			int digit = 0;
+			while (digit < inputs && ++digits[digit] == values.size())
+			{
+				digits[digit++] = 0;
+			}
+			if (digit == inputs)
+			{
+				break;
+			}
+		}
+	}
+
+	mt19937_64 random(tests);
+	for (int i = 0; i < RANDOM_CHECKS; i++)
+	{
+		RandomTest(a_problem, random, test);
+		if (!check())
+		{
+			return 0;
+		}
+	}
+	return tests;
+}
@@ -0,0 +1,154 @@
+//
+//		Superoptimizer class - searches for shorter instruction sequences that do what the hot parts
+//		of a VC3600 program do.
+//
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <vector>
+#include "Emulator.h"
+
+class Superoptimizer {
+
+public:
+
+	// One instruction of a sequence.
+	struct Step {
+		int opCode;
+		int address;
+	};
+
+	// A sequence in the program, and the shorter one that does the same.
+	struct Finding {
+		int location;				// Where the sequence starts.
+		long long executions;		// How often its first instruction ran.
+		vector<Step> target;		// The instructions in the program.
+		vector<Step> replacement;	// The shortest sequence found that does the same.
+		long long vectorsChecked;	// The inputs the replacement was checked on.
+	};
+
+	// Prepares to search the program loaded into the emulator for sequences of up to
+	// a_maxLength instructions, on a_threads threads.
+	Superoptimizer(const Emulator &a_emul, int a_maxLength, int a_threads);
+
+	// Searches the a_blocks hottest blocks of straight-line code, going by the profile. Returns
+	// false if the program can change its own code, which makes no sequence safe to replace.
+	bool Run(const Profiler &a_profile, int a_blocks);
+
+	// What was found, in the order the blocks were searched.
+	const vector<Finding> &GetFindings() const { return m_findings; }
+
+	// The sequences searched, and the candidates tried for them.
+	int GetTargetCount() const { return m_targets; }
+	long long GetCandidateCount() const { return m_candidates; }
+
+private:
+
+	// The most words a sequence may read, and the most constants the candidates may use.
+	static const int MAX_SLOTS = 24;
+	static const int MAX_CONSTANTS = 12;
+
+	// The inputs of the cheap tests, and how many inputs at most the full check tries.
+	static const int CHEAP_TESTS = 64;
+	static const long long CHECK_BUDGET = 1 << 20;
+	static const int RANDOM_CHECKS = 1 << 16;
+
+	// How a run of a sequence ends.
+	enum Outcome { RAN, STORE_TOO_BIG, DIVIDE_BY_ZERO };
+
+	// An instruction with its operand as a slot: a word the sequence reads or writes, or a constant.
+	struct SlotStep {
+		int opCode;
+		int slot;
+	};
+
+	// The accumulator, the slots, and how the run is going.
+	struct State {
+		Emulator::Word accumulator;
+		Outcome outcome;
+		Emulator::Word slots[MAX_SLOTS];
+	};
+
+	// The values given to the words a sequence reads, and the accumulator, for one test.
+	struct TestVector {
+		Emulator::Word accumulator;
+		Emulator::Word inputs[MAX_SLOTS];
+	};
+
+	// Everything the workers need to know about one sequence.
+	struct Problem {
+		vector<SlotStep> target;		// The sequence, in slots.
+		int inputs = 0;					// The slots that are words of memory, which come first.
+		int slots = 0;					// Those and the constants.
+		vector<int> addresses;			// The address of each slot.
+		vector<Emulator::Word> constants;	// The value of each constant slot.
+		bool accumulatorIn = false;		// == true if the sequence uses the accumulator it starts with.
+		bool accumulatorOut = false;	// == true if the accumulator is used after the sequence.
+		vector<int> stored;				// The slots the sequence stores into.
+		vector<SlotStep> alphabet;		// The instructions a candidate is made of.
+		vector<TestVector> tests;		// The cheap tests.
+		vector<State> expected;			// What the sequence does on each of them.
+	};
+
+	// What the threads share while they search for the candidates of one length. Each takes the
+	// next first instruction in turn, and tries every candidate that starts with it.
+	struct LengthSearch {
+		const Problem *problem;			// What is searched for.
+		int length;						// The instructions in each candidate.
+		atomic<int> nextFirst{0};		// The next first instruction to take, in the alphabet.
+		atomic<long long> tried{0};		// The candidates tried.
+		mutex lock;						// Guards the rest.
+		int bestFirst;					// The first instruction of the best candidate, or past the alphabet.
+		vector<int> best;				// The best candidate, in the alphabet.
+		long long checked = 0;			// The inputs it was checked on.
+	};
+
+	const Emulator &m_emul;			// The program.
+	int m_maxLength;				// The longest sequence searched.
+	int m_threads;					// The threads the search runs on.
+	vector<unsigned char> m_written;	// == 1 for each word the program can write.
+	vector<unsigned char> m_operand;	// == 1 for each word an instruction names.
+	vector<unsigned char> m_branchTarget;	// == 1 for each word a branch can go to.
+	vector<Finding> m_findings;		// What was found.
+	int m_targets = 0;				// The sequences searched.
+	long long m_candidates = 0;		// The candidates tried.
+
+	// Searches for the shortest sequence that does what a part of a block does.
+	bool Search(int a_location, const vector<Step> &a_target, Finding &a_finding);
+
+	// Tries the candidates that start with each first instruction the search hands out.
+	void Worker(LengthSearch *a_search);
+
+	// Tries every way of filling in a candidate from a_depth on, a_state being where the first test
+	// has got to. Returns true once one does what the sequence does, leaving it in a_candidate.
+	static bool Extend(const Problem &a_problem, vector<int> &a_candidate, int a_depth, const State &a_state,
+		long long &a_tried, long long &a_checked);
+
+	// Determines if a candidate with a_step after a_previous can be skipped, because a shorter one
+	// does the same. a_previous is -1 for the first instruction.
+	static bool Redundant(const Problem &a_problem, int a_previous, int a_step);
+
+	// Turns a sequence into slots, and works out what it reads, writes and leaves behind.
+	bool MakeProblem(int a_location, const vector<Step> &a_target, Problem &a_problem) const;
+
+	// Runs one instruction.
+	static void Execute(const SlotStep &a_step, State &a_state);
+
+	// Sets up the state for a test.
+	static void StartState(const Problem &a_problem, const TestVector &a_test, State &a_state);
+
+	// Determines if two runs ended the same way, as far as the rest of the program can tell.
+	static bool SameResult(const Problem &a_problem, const State &a_first, const State &a_second);
+
+	// Runs a whole sequence on a test.
+	static void RunSequence(const Problem &a_problem, const vector<SlotStep> &a_sequence, const TestVector &a_test, State &a_state);
+
+	// Makes a test from random values, some of them at the edges of what a word holds.
+	static void RandomTest(const Problem &a_problem, mt19937_64 &a_random, TestVector &a_test);
+
+	// Checks a candidate that passed the cheap tests on every combination of the values that
+	// matter most, and on many random tests. Returns the number of tests, or 0 if one failed.
+	static long long CheckFully(const Problem &a_problem, const vector<SlotStep> &a_candidate);
+};
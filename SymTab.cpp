@@ -11,7 +11,7 @@ AddSymbol - adds a new symbol to the symbol table.
 
 SYNOPSIS
 
-void AddSymbol(string &a_symbol, int a_loc);
+void AddSymbol(string_view a_symbol, int a_loc);
 
 DESCRIPTION
 
@@ -19,10 +19,10 @@ This function will place the symbol "a_symbol" and its location "a_loc"
 in the symbol table.
 */
 void
-SymbolTable::AddSymbol(string &a_symbol, int a_loc)
+SymbolTable::AddSymbol(string_view a_symbol, int a_loc)
 {
 	// If the symbol is already in the symbol table, record it as multiply defined.
-	map<string, int>::iterator st;
+	map<string, int, less<>>::iterator st;
 	st = m_symbolTable.find(a_symbol);
 	if (st != m_symbolTable.end())
 	{
@@ -30,11 +30,11 @@ SymbolTable::AddSymbol(string &a_symbol, int a_loc)
 		return;
 	}
 	// Record the location in the symbol table.
-	m_symbolTable[a_symbol] = a_loc;
+	m_symbolTable.emplace(a_symbol, a_loc);
 }
 
 /*
-void SymbolTable::DisplaySymbolTable()
+void SymbolTable::DisplaySymbolTable(bool a_pause)
 
 NAME
 
@@ -43,7 +43,8 @@ the function
 
 SYNOPSIS
 
-void SymbolTable::DisplaySymbolTable();
+void SymbolTable::DisplaySymbolTable(bool a_pause);
+	a_pause -> whether to wait for the user once the table has been displayed
 
 DESCRIPTION
 
@@ -51,21 +52,24 @@ This function displays the Symbol Table by iterating through it from beginning t
 also places a dotted line to separate it from the machine code translation that will come
 later.
 */
-void SymbolTable::DisplaySymbolTable()
+void SymbolTable::DisplaySymbolTable(bool a_pause)
 {
 	int numberCount = 0;
 	cout << "Symbol Table:" << endl;
 	cout << endl;
 	cout << "Symbol#\tSymbol\tLocation" << endl;
 
-	for (map<string, int>::iterator it = m_symbolTable.begin(); it != m_symbolTable.end(); it++)
+	for (map<string, int, less<>>::iterator it = m_symbolTable.begin(); it != m_symbolTable.end(); it++)
 	{
 		cout << numberCount << "\t" << it->first << "\t" << it->second << endl;
 		numberCount++;
 	}
 
 	cout << "---------------------------------------------" << endl;
-	system("pause");
+	if (a_pause)
+	{
+		system("pause");
+	}
 }
 
 /*
@@ -77,7 +81,7 @@ void SymbolTable::LookupSymbol - looks up the symbol in the symbol table
 
 SYNOPSIS
 
-bool SymbolTable::LookupSymbol(string &a_symbol, int &a_loc);
+bool SymbolTable::LookupSymbol(string_view a_symbol, int &a_loc);
 	a_symbol -> symbol to be looked up
 	a_loc -> location of the symbol
 
@@ -91,9 +95,9 @@ RETURNS
 Returns true if the symbol was successfully found. Returns false if the symbol could not
 be found.
 */
-bool SymbolTable::LookupSymbol(string &a_symbol, int &a_loc)
+bool SymbolTable::LookupSymbol(string_view a_symbol, int &a_loc)
 {
-	map<string, int>::iterator st;
+	map<string, int, less<>>::iterator st;
 	st = m_symbolTable.find(a_symbol);
 	if (st != m_symbolTable.end())
 	{
@@ -3,6 +3,8 @@
 //		text file.
 #pragma once
 
+#include <string_view>
+
 // This class is our symbol table.
 class SymbolTable {
 
@@ -11,17 +13,21 @@ public:
 	const int multiplyDefinedSymbol = -999;
 
 	// Add a new symbol to the symbol table.
-	void AddSymbol(string &a_symbol, int a_loc);
+	void AddSymbol(string_view a_symbol, int a_loc);
 
-	// Display the symbol table.
-	void DisplaySymbolTable();
+	// Display the symbol table, and pause for the user if asked to.
+	void DisplaySymbolTable(bool a_pause = true);
 
 	// Lookup a symbol in the symbol table.
-	bool LookupSymbol(string &a_symbol, int &a_loc);
+	bool LookupSymbol(string_view a_symbol, int &a_loc);
+
+	// To access every symbol and its location.
+	const map<string, int, less<>> &GetSymbols() const { return m_symbolTable; }
 
 private:
 
-	// This is the actual symbol table.  The symbol is the key to the map.
-	map<string, int> m_symbolTable;
+	// This is the actual symbol table.  The symbol is the key to the map, which can be looked up
+	// by a string_view without making a string of it.
+	map<string, int, less<>> m_symbolTable;
 
 };
\ No newline at end of file